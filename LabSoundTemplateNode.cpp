@@ -1,5 +1,8 @@
 
 #include "LabSoundTemplateNode.h"
+#include "NodeScheduleQueue.h"
+#include "NodeTrace.h"
+#include "RealtimeCheck.h"
 #include <LabSound/core/AudioBus.h>
 #include <LabSound/core/AudioContext.h>
 #include <LabSound/core/AudioNodeOutput.h>
@@ -31,9 +34,10 @@ struct LabSoundTemplateNodeEvent
 
 struct LabSoundTemplateNode::Detail
 {
-    std::priority_queue<LabSoundTemplateNodeEvent> queue;
+    NodeScheduleQueue<LabSoundTemplateNodeEvent> queue;
     moodycamel::ConcurrentQueue<LabSoundTemplateNodeEvent> incoming;
     lab::AudioContext* ac = nullptr;
+    NodeRenderCounters stats;
 
     Detail() = default;
     ~Detail() = default;
@@ -41,9 +45,12 @@ struct LabSoundTemplateNode::Detail
     void clearSchedules()
     {
         LabSoundTemplateNodeEvent s;
-        while (incoming.try_dequeue(s)) {}
+        size_t dropped = queue.size();
+        while (incoming.try_dequeue(s))
+            ++dropped;
         while (!queue.empty())
             queue.pop();
+        stats.recordDropped(dropped);
     }
 };
 
@@ -77,7 +84,10 @@ void LabSoundTemplateNode::realtimeEvent(float when, int identifier)
 
 void LabSoundTemplateNode::process(ContextRenderLock &r, int bufferSize)
 {
+    NODE_TRACE_SCOPE("LabSoundTemplate process");
+    NODE_REALTIME_SCOPE("LabSoundTemplate process");
     AudioBus * outputBus = output(0)->bus(r);
+    NodeRenderTimer timer(_detail->stats, bufferSize);
 
     if (!isInitialized())
     {
@@ -89,11 +99,13 @@ void LabSoundTemplateNode::process(ContextRenderLock &r, int bufferSize)
     }
 
     // move incoming commands to the internal schedule
+    int arrived = 0;
     {
         LabSoundTemplateNodeEvent s;
         while (_detail->incoming.try_dequeue(s))
         {
             _detail->queue.push(s);
+            ++arrived;
         }
     }
 
@@ -108,6 +120,9 @@ void LabSoundTemplateNode::process(ContextRenderLock &r, int bufferSize)
     while (!_detail->queue.empty() && _detail->queue.top().when < quantumEnd)
     {
         auto& top = _detail->queue.top();
+        NODE_TRACE_INSTANT("LabSoundTemplate event", top.id);
+        if (top.when < quantumStart)
+            _detail->stats.recordLate(quantumStart - top.when);
 
         // compute the exact sample the event occurs at
         int offset = (top.when < quantumStart) ? 0 : static_cast<int>((top.when - quantumStart) * ac.sampleRate());
@@ -127,6 +142,19 @@ void LabSoundTemplateNode::process(ContextRenderLock &r, int bufferSize)
 
     if (events > 0)
         outputBus->clearSilentFlag();
+
+    timer.events = events;
+    _detail->stats.recordQueues(arrived, _detail->queue.size());
+}
+
+NodeRenderStats LabSoundTemplateNode::renderStats() const
+{
+    return _detail->stats.snapshot();
+}
+
+void LabSoundTemplateNode::resetRenderStats()
+{
+    _detail->stats.reset();
 }
 
 void LabSoundTemplateNode::reset(ContextRenderLock&)
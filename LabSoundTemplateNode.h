@@ -3,6 +3,7 @@
 #define LABSOUND_TEMPLATE_NODE
 
 #include <LabSound/core/AudioNode.h>
+#include "NodeRenderStats.h"
 
 class LabSoundTemplateNode : public lab::AudioNode
 {
@@ -23,6 +24,10 @@ public:
 
     void realtimeEvent(float when, int identifier);
 
+    // Render time and schedule counters, see NodeRenderStats.h
+    NodeRenderStats renderStats() const;
+    void resetRenderStats();
+
 private:
     virtual bool propagatesSilence(lab::ContextRenderLock& r) const override { return false; }
     virtual double tailTime(lab::ContextRenderLock & r) const override { return 0; }
@@ -0,0 +1,646 @@
+
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright (C) 2020, The LabSound Authors. All rights reserved.
+
+// Render throughput benchmarks for the synth nodes. Every case renders in an
+// offline context pulled by the null device, so no audio device is needed,
+// and reports the best of several runs as nanoseconds per frame and as a
+// realtime factor. Timings cover the whole graph, which for these cases is
+// the node under test feeding the device.
+//
+// LabSynthBench [--seconds s] [--repeat n] [--filter text] [--json out.json] [--assets dir] [--trace out.json]
+//
+// With --deadline, it instead measures each render quantum of a graph of
+// many node instances against the quantum's deadline, and finds how many
+// instances one core can sustain.
+//
+// LabSynthBench --deadline tsf|pocketmod|mixed [--instances n] [--budget 0.7] [--seconds s] [--json out.json] [--trace out.json]
+
+#include "LabSynthToy.h"
+#include "TinySoundFontNode.h"
+#include "PocketModNode.h"
+#include "NodeTrace.h"
+#include "RealtimeCheck.h"
+#include "MidiFilePlayer.h"
+
+#if defined(_MSC_VER)
+    #if !defined(_CRT_SECURE_NO_WARNINGS)
+        #define _CRT_SECURE_NO_WARNINGS
+    #endif
+    #if !defined(NOMINMAX)
+        #define NOMINMAX
+    #endif
+#endif
+
+#include "LabSound/LabSound.h"
+#include "LabSound/core/AudioNodeInput.h"
+#include "LabSound/core/AudioNodeOutput.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace lab;
+
+namespace
+{
+    const float sample_rate = 44100.f;
+
+    const char* bundled_songs[] = {
+        "bananasplit", "chill", "elysium", "king", "nemesis", "overture",
+        "spacedeb", "stardstm", "sundance", "sundown", "supernova" };
+
+    struct BenchResult
+    {
+        std::string name;
+        std::string node;
+        std::string params;
+        double seconds = 0;
+        double elapsed = 0;     // best wall clock time over the runs
+    };
+
+    struct BenchOptions
+    {
+        double seconds = 10.;
+        int repeat = 3;
+        std::string filter;
+        std::string json_path;
+        std::string assets = synth_toy_asset_base;
+        std::string trace_path;         // needs a build with LABSYNTHTOY_TRACE
+
+        // deadline mode
+        std::string deadline_graph;     // tsf, pocketmod or mixed
+        int instances = 0;              // zero searches for the most that fit
+        double budget = 0.7;            // of the quantum period, at p99.9
+    };
+
+    std::unique_ptr<lab::AudioContext> make_context(double seconds)
+    {
+        AudioStreamConfig offlineConfig;
+        offlineConfig.device_index = 0;
+        offlineConfig.desired_samplerate = sample_rate;
+        offlineConfig.desired_channels = 2;
+        return lab::MakeOfflineAudioContext(offlineConfig, seconds * 1000.);
+    }
+
+    // the nodes a case creates, kept alive until its render is done
+    using Graph = std::vector<std::shared_ptr<lab::AudioNode>>;
+    using GraphSetup = std::function<void(lab::AudioContext&, Graph&)>;
+
+    // Renders one run of a case and returns the wall clock time spent
+    // rendering; building the graph is not timed.
+    double render_once(double seconds, const GraphSetup& setup)
+    {
+        std::unique_ptr<lab::AudioContext> context = make_context(seconds);
+        Graph graph;
+        setup(*context.get(), graph);
+
+        std::mutex complete_mutex;
+        std::condition_variable complete_cv;
+        bool complete = false;
+        context->offlineRenderCompleteCallback = [&]()
+        {
+            std::lock_guard<std::mutex> lock(complete_mutex);
+            complete = true;
+            complete_cv.notify_one();
+        };
+
+        // so the render thread's first quantum doesn't allocate its trace ring
+        NodeTrace::reserveThreads(1);
+
+        auto start = std::chrono::steady_clock::now();
+        context->startOfflineRendering();
+        {
+            std::unique_lock<std::mutex> lock(complete_mutex);
+            complete_cv.wait(lock, [&] { return complete; });
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    class Bench
+    {
+    public:
+        explicit Bench(const BenchOptions& options) : options(options) {}
+
+        void run(const std::string& name, const std::string& node, const std::string& params,
+            const GraphSetup& setup)
+        {
+            if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+                return;
+
+            BenchResult result { name, node, params, options.seconds, 0 };
+            for (int i = 0; i < options.repeat; ++i)
+            {
+                double elapsed = render_once(options.seconds, setup);
+                if (i == 0 || elapsed < result.elapsed)
+                    result.elapsed = elapsed;
+            }
+
+            printf("%-32s %10.1f ns/frame %8.1fx realtime\n", name.c_str(),
+                ns_per_frame(result), result.seconds / result.elapsed);
+            results.push_back(result);
+        }
+
+        bool writeJson(const std::string& path) const
+        {
+            FILE* f = fopen(path.c_str(), "w");
+            if (!f)
+            {
+                printf("Couldn't write %s\n", path.c_str());
+                return false;
+            }
+
+            fprintf(f, "{\n  \"sample_rate\": %d,\n  \"seconds\": %g,\n  \"repeat\": %d,\n  \"results\": [\n",
+                int(sample_rate), options.seconds, options.repeat);
+            for (size_t i = 0; i < results.size(); ++i)
+            {
+                const BenchResult& r = results[i];
+                fprintf(f, "    { \"name\": \"%s\", \"node\": \"%s\", \"params\": \"%s\", "
+                    "\"frames\": %lld, \"elapsed\": %.6f, \"ns_per_frame\": %.2f, \"realtime_factor\": %.2f }%s\n",
+                    r.name.c_str(), r.node.c_str(), r.params.c_str(),
+                    (long long) (r.seconds * sample_rate), r.elapsed, ns_per_frame(r), r.seconds / r.elapsed,
+                    i + 1 < results.size() ? "," : "");
+            }
+            fprintf(f, "  ]\n}\n");
+            fclose(f);
+            return true;
+        }
+
+        const BenchOptions& options;
+
+    private:
+        static double ns_per_frame(const BenchResult& r)
+        {
+            return r.elapsed * 1e9 / (r.seconds * sample_rate);
+        }
+
+        std::vector<BenchResult> results;
+    };
+
+    std::vector<unsigned char> read_file(const std::string& path)
+    {
+        std::vector<unsigned char> data;
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f)
+            return data;
+
+        fseek(f, 0, SEEK_END);
+        data.resize(size_t(ftell(f)));
+        fseek(f, 0, SEEK_SET);
+        if (fread(data.data(), 1, data.size(), f) != data.size())
+            data.clear();
+        fclose(f);
+        return data;
+    }
+
+    // The bundled songs are all four channel MODs. A wider song is made by
+    // copying each pattern row's four cells across the extra channels, so
+    // every channel plays the same notes and effects as one of the originals.
+    std::vector<unsigned char> widen_mod(const std::vector<unsigned char>& mod, int channels)
+    {
+        const size_t header = 1084;
+        const size_t row = 4 * 4;
+        if (mod.size() < header || memcmp(&mod[1080], "M.K.", 4) != 0)
+            return {};
+
+        int patterns = 0;
+        for (int i = 0; i < 128; ++i)
+            patterns = std::max(patterns, mod[952 + i] + 1);
+
+        const size_t pattern_data = size_t(patterns) * 64 * row;
+        if (mod.size() < header + pattern_data)
+            return {};
+
+        std::vector<unsigned char> wide(mod.begin(), mod.begin() + header);
+        char tag[5];
+        snprintf(tag, sizeof(tag), channels < 10 ? "%dCHN" : "%dCH", channels);
+        memcpy(&wide[1080], tag, 4);
+
+        for (size_t r = 0; r < size_t(patterns) * 64; ++r)
+        {
+            const unsigned char* cells = &mod[header + r * row];
+            for (int c = 0; c < channels; ++c)
+                wide.insert(wide.end(), cells + (c % 4) * 4, cells + (c % 4) * 4 + 4);
+        }
+
+        wide.insert(wide.end(), mod.begin() + header + pattern_data, mod.end());
+        return wide;
+    }
+
+    // held chords, struck again every half second so the voice count stays put
+    void strike(TinySoundFontNode& node, int preset, int voices, double seconds)
+    {
+        for (float t = 0; t < seconds; t += 0.5f)
+        {
+            for (int v = 0; v < voices; ++v)
+            {
+                const int key = 24 + v;
+                if (t > 0)
+                    node.noteOff(t, preset, key);
+                node.noteOn(t, preset, key, 0.5f);
+            }
+        }
+    }
+
+    void bench_tsf(Bench& bench)
+    {
+        const std::string sf2_path = bench.options.assets + "florestan-subset.sf2";
+        const double seconds = bench.options.seconds;
+
+        for (int voices : { 1, 8, 32, 96 })
+        {
+            bench.run("tsf/voices/" + std::to_string(voices), "TinySoundFont",
+                "preset=0 voices=" + std::to_string(voices), [&](lab::AudioContext& ac, Graph& graph)
+            {
+                std::shared_ptr<TinySoundFontNode> node(new TinySoundFontNode(ac));
+                node->load_sf2(sf2_path.c_str());
+                strike(*node, 0, voices, seconds);
+                ac.connect(ac.device(), node, 0, 0);
+                graph.push_back(node);
+            });
+        }
+
+        int presets = 0;
+        {
+            std::unique_ptr<lab::AudioContext> context = make_context(seconds);
+            std::shared_ptr<TinySoundFontNode> node(new TinySoundFontNode(*context.get()));
+            node->load_sf2(sf2_path.c_str());
+            presets = node->presetCount();
+        }
+
+        for (int preset = 0; preset < std::min(presets, 4); ++preset)
+        {
+            bench.run("tsf/preset/" + std::to_string(preset), "TinySoundFont",
+                "preset=" + std::to_string(preset) + " voices=16", [&](lab::AudioContext& ac, Graph& graph)
+            {
+                std::shared_ptr<TinySoundFontNode> node(new TinySoundFontNode(ac));
+                node->load_sf2(sf2_path.c_str());
+                strike(*node, preset, 16, seconds);
+                ac.connect(ac.device(), node, 0, 0);
+                graph.push_back(node);
+            });
+        }
+
+        const std::string midi_path = bench.options.assets + "venture.mid";
+        std::shared_ptr<MidiSong> song = MidiSong::load(midi_path.c_str());
+        if (!song)
+            return;
+
+        bench.run("tsf/song/venture", "TinySoundFont", "song=venture.mid", [&](lab::AudioContext& ac, Graph& graph)
+        {
+            std::shared_ptr<TinySoundFontNode> node(new TinySoundFontNode(ac));
+            node->load_sf2(sf2_path.c_str());
+            for (const MidiEvent& e : song->events)
+            {
+                if (e.time * 1e-3 >= seconds)
+                    break;
+                MidiFilePlayer::schedule(*node, e, float(e.time) * 1e-3f);
+            }
+            ac.connect(ac.device(), node, 0, 0);
+            graph.push_back(node);
+        });
+    }
+
+    void bench_pocketmod(Bench& bench)
+    {
+        auto play = [](std::shared_ptr<PocketModSong> song, PocketModNode::Interpolation mode)
+        {
+            return [song, mode](lab::AudioContext& ac, Graph& graph)
+            {
+                std::shared_ptr<PocketModNode> node(new PocketModNode(ac));
+                node->setInterpolation(mode);
+                node->play(song);
+                node->start(0.f);
+                ac.connect(ac.device(), node, 0, 0);
+                graph.push_back(node);
+            };
+        };
+
+        for (const char* name : bundled_songs)
+        {
+            const std::string path = bench.options.assets + name + ".mod";
+            std::shared_ptr<PocketModSong> song = PocketModNode::loadSong(path.c_str());
+            if (song)
+                bench.run(std::string("pocketmod/song/") + name, "PocketMod",
+                    std::string("song=") + name + ".mod interpolation=linear",
+                    play(song, PocketModNode::Interpolation::Linear));
+        }
+
+        const std::string path = bench.options.assets + "elysium.mod";
+        std::shared_ptr<PocketModSong> song = PocketModNode::loadSong(path.c_str());
+        if (!song)
+            return;
+
+        const struct { const char* name; PocketModNode::Interpolation mode; } modes[] = {
+            { "nearest", PocketModNode::Interpolation::Nearest },
+            { "linear", PocketModNode::Interpolation::Linear },
+            { "cubic", PocketModNode::Interpolation::Cubic },
+            { "sinc", PocketModNode::Interpolation::Sinc } };
+
+        for (auto& m : modes)
+            bench.run(std::string("pocketmod/interpolation/") + m.name, "PocketMod",
+                std::string("song=elysium.mod interpolation=") + m.name, play(song, m.mode));
+
+        const std::vector<unsigned char> mod = read_file(path);
+        for (int channels : { 4, 8, 16, 32 })
+        {
+            // the song data must outlive the song, which only borrows it
+            const std::vector<unsigned char> wide = widen_mod(mod, channels);
+            std::shared_ptr<PocketModSong> wide_song = wide.empty() ? nullptr : PocketModNode::loadSong(wide.data(), wide.size());
+            if (!wide_song)
+                continue;
+
+            bench.run("pocketmod/channels/" + std::to_string(channels), "PocketMod",
+                "song=elysium.mod channels=" + std::to_string(channels) + " interpolation=linear",
+                play(wide_song, PocketModNode::Interpolation::Linear));
+        }
+    }
+
+    // Renders nothing itself. Everything under test connects to its input, so
+    // it is pulled once per render quantum after all of them, and it records
+    // the wall clock time from the end of one quantum to the end of the next.
+    // An offline context renders quanta back to back on one thread, so that
+    // is how long the graph took to produce each quantum, as it would inside
+    // a device callback on one core.
+    class QuantumProbeNode : public lab::AudioNode
+    {
+    public:
+        QuantumProbeNode(lab::AudioContext& ac, size_t quanta) : AudioNode(ac)
+        {
+            addInput(std::unique_ptr<AudioNodeInput>(new AudioNodeInput(this)));
+            addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 1)));
+            durations.reserve(quanta);
+            initialize();
+        }
+
+        virtual ~QuantumProbeNode()
+        {
+            uninitialize();
+        }
+
+        static const char* static_name() { return "QuantumProbe"; }
+        virtual const char* name() const override { return static_name(); }
+
+        virtual void process(lab::ContextRenderLock& r, int bufferSize) override
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (frames > 0 && durations.size() < durations.capacity())
+                durations.push_back(std::chrono::duration<float>(now - last).count());
+
+            last = now;
+            frames = bufferSize;
+            output(0)->bus(r)->zero();
+        }
+
+        virtual void reset(lab::ContextRenderLock&) override {}
+
+        std::vector<float> durations;   // seconds, one per quantum after the first
+        int frames = 0;                 // per quantum
+
+    private:
+        virtual bool propagatesSilence(lab::ContextRenderLock& r) const override { return false; }
+        virtual double tailTime(lab::ContextRenderLock& r) const override { return 0; }
+        virtual double latencyTime(lab::ContextRenderLock& r) const override { return 0; }
+
+        std::chrono::steady_clock::time_point last;
+    };
+
+    struct DeadlineResult
+    {
+        int instances = 0;
+        int quanta = 0;
+        double period = 0;      // seconds per quantum at the device's rate
+        double p50 = 0;
+        double p99 = 0;
+        double p999 = 0;
+        double max = 0;
+        int misses = 0;
+    };
+
+    // Renders the given number of instances and measures every quantum against
+    // a simulated device clock, which calls back once per quantum period and
+    // expects the quantum within that period. TinySoundFont instances hold a
+    // sixteen note chord; PocketMod instances loop the bundled songs.
+    DeadlineResult measure_deadlines(const BenchOptions& options, int instances)
+    {
+        const std::string& graph_kind = options.deadline_graph;
+        const std::string sf2_path = options.assets + "florestan-subset.sf2";
+
+        std::vector<std::shared_ptr<PocketModSong>> songs;
+        if (graph_kind != "tsf")
+        {
+            for (const char* name : bundled_songs)
+            {
+                const std::string path = options.assets + name + ".mod";
+                if (std::shared_ptr<PocketModSong> song = PocketModNode::loadSong(path.c_str()))
+                    songs.push_back(song);
+            }
+        }
+
+        const size_t quanta = size_t(options.seconds * sample_rate / AudioNode::ProcessingSizeInFrames) + 1;
+        std::shared_ptr<QuantumProbeNode> probe;
+        render_once(options.seconds, [&](lab::AudioContext& ac, Graph& graph)
+        {
+            probe.reset(new QuantumProbeNode(ac, quanta));
+            ac.connect(ac.device(), probe, 0, 0);
+            graph.push_back(probe);
+
+            for (int i = 0; i < instances; ++i)
+            {
+                if (songs.empty() || (graph_kind == "mixed" && i % 2 == 0))
+                {
+                    std::shared_ptr<TinySoundFontNode> node(new TinySoundFontNode(ac));
+                    node->load_sf2(sf2_path.c_str());
+                    strike(*node, 0, 16, options.seconds);
+                    ac.connect(probe, node, 0, 0);
+                    graph.push_back(node);
+                }
+                else
+                {
+                    std::shared_ptr<PocketModNode> node(new PocketModNode(ac));
+                    node->play(songs[i % songs.size()]);
+                    node->start(0.f);
+                    ac.connect(probe, node, 0, 0);
+                    graph.push_back(node);
+                }
+            }
+        });
+
+        DeadlineResult result;
+        result.instances = instances;
+        std::vector<float> durations = probe->durations;
+        if (durations.empty() || !probe->frames)
+            return result;
+
+        std::sort(durations.begin(), durations.end());
+        auto percentile = [&durations](double p)
+        {
+            return double(durations[std::min(durations.size() - 1, size_t(p * durations.size()))]);
+        };
+
+        result.quanta = int(durations.size());
+        result.period = probe->frames / sample_rate;
+        result.p50 = percentile(0.5);
+        result.p99 = percentile(0.99);
+        result.p999 = percentile(0.999);
+        result.max = durations.back();
+        result.misses = int(durations.end() - std::upper_bound(durations.begin(), durations.end(), float(result.period)));
+
+        printf("%-10s %5d instances  p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us  of %.1f us, %d of %d missed\n",
+            graph_kind.c_str(), instances, result.p50 * 1e6, result.p99 * 1e6, result.p999 * 1e6, result.max * 1e6,
+            result.period * 1e6, result.misses, result.quanta);
+        return result;
+    }
+
+    // With a fixed instance count, measures just that. Otherwise doubles the
+    // count until p99.9 leaves the budget, then bisects for the largest count
+    // that stays within it: the number of instances one core can sustain.
+    bool bench_deadlines(const BenchOptions& options)
+    {
+        const std::string& graph_kind = options.deadline_graph;
+        if (graph_kind != "tsf" && graph_kind != "pocketmod" && graph_kind != "mixed")
+        {
+            printf("Unknown graph %s, expected tsf, pocketmod or mixed\n", graph_kind.c_str());
+            return false;
+        }
+
+        std::vector<DeadlineResult> trials;
+        auto fits = [&](int instances)
+        {
+            trials.push_back(measure_deadlines(options, instances));
+            const DeadlineResult& r = trials.back();
+            return r.quanta > 0 && r.p999 <= options.budget * r.period;
+        };
+
+        int sustained = 0;
+        if (options.instances > 0)
+        {
+            if (fits(options.instances))
+                sustained = options.instances;
+        }
+        else if (fits(1))
+        {
+            const int max_search = 4096;
+            int lo = 1, hi = 2;
+            while (hi <= max_search && fits(hi))
+            {
+                lo = hi;
+                hi *= 2;
+            }
+            while (hi - lo > 1 && lo < max_search)
+            {
+                int mid = (lo + hi) / 2;
+                if (fits(mid))
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+            sustained = lo;
+        }
+
+        printf("%s: %d instances per core with p99.9 within %.0f%% of the quantum\n",
+            graph_kind.c_str(), sustained, options.budget * 100.);
+
+        if (options.json_path.empty())
+            return true;
+
+        FILE* f = fopen(options.json_path.c_str(), "w");
+        if (!f)
+        {
+            printf("Couldn't write %s\n", options.json_path.c_str());
+            return false;
+        }
+
+        fprintf(f, "{\n  \"graph\": \"%s\",\n  \"sample_rate\": %d,\n  \"seconds\": %g,\n  \"budget\": %g,\n"
+            "  \"max_instances_per_core\": %d,\n  \"trials\": [\n",
+            graph_kind.c_str(), int(sample_rate), options.seconds, options.budget, sustained);
+        for (size_t i = 0; i < trials.size(); ++i)
+        {
+            const DeadlineResult& r = trials[i];
+            fprintf(f, "    { \"instances\": %d, \"quanta\": %d, \"period_us\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, "
+                "\"p999_us\": %.1f, \"max_us\": %.1f, \"misses\": %d }%s\n",
+                r.instances, r.quanta, r.period * 1e6, r.p50 * 1e6, r.p99 * 1e6, r.p999 * 1e6, r.max * 1e6, r.misses,
+                i + 1 < trials.size() ? "," : "");
+        }
+        fprintf(f, "  ]\n}\n");
+        fclose(f);
+        return true;
+    }
+}
+
+int main(int argc, char *argv[]) try
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc)
+            options.seconds = std::max(0.1, atof(argv[++i]));
+        else if (arg == "--repeat" && i + 1 < argc)
+            options.repeat = std::max(1, atoi(argv[++i]));
+        else if (arg == "--filter" && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (arg == "--json" && i + 1 < argc)
+            options.json_path = argv[++i];
+        else if (arg == "--assets" && i + 1 < argc)
+            options.assets = std::string(argv[++i]) + "/";
+        else if (arg == "--trace" && i + 1 < argc)
+            options.trace_path = argv[++i];
+        else if (arg == "--deadline" && i + 1 < argc)
+            options.deadline_graph = argv[++i];
+        else if (arg == "--instances" && i + 1 < argc)
+            options.instances = std::max(1, atoi(argv[++i]));
+        else if (arg == "--budget" && i + 1 < argc)
+            options.budget = std::max(0.01, atof(argv[++i]));
+        else
+        {
+            printf("usage: LabSynthBench [--seconds s] [--repeat n] [--filter text] [--json out.json] [--assets dir] [--trace out.json]\n"
+                   "       LabSynthBench --deadline tsf|pocketmod|mixed [--instances n] [--budget 0.7] [--seconds s] [--json out.json] [--trace out.json]\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool ok = true;
+    if (!options.deadline_graph.empty())
+    {
+        ok = bench_deadlines(options);
+    }
+    else
+    {
+        Bench bench(options);
+        bench_tsf(bench);
+        bench_pocketmod(bench);
+
+        if (!options.json_path.empty())
+            ok = bench.writeJson(options.json_path);
+    }
+
+    // the rings keep only each thread's latest events, so this shows the end of the run
+    if (!options.trace_path.empty() && !NodeTrace::writeChromeJson(options.trace_path))
+    {
+        printf("Couldn't write a trace to %s; tracing needs a build with LABSYNTHTOY_TRACE\n", options.trace_path.c_str());
+        ok = false;
+    }
+
+    // every case doubles as a realtime safety test in a LABSYNTHTOY_RT_CHECK build
+    if (RealtimeCheck::enabled())
+    {
+        const uint64_t violations = RealtimeCheck::violations();
+        printf("%llu realtime violations\n", (unsigned long long) violations);
+        if (violations > 0)
+            ok = false;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (const std::exception & e)
+{
+    std::cerr << "unhandled fatal exception: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -3,9 +3,8 @@
 #include "TinySoundFontNode.h"
 #include "LabSoundTemplateNode.h"
 #include "PocketModNode.h"
-
-#define TML_IMPLEMENTATION
-#include "TinySoundFont/tml.h"
+#include "MidiFilePlayer.h"
+#include "MidiInput.h"
 
 // SPDX-License-Identifier: BSD-2-Clause
 // Copyright (C) 2020, The LabSound Authors. All rights reserved.
@@ -21,7 +20,14 @@
 
 #include "LabSound/LabSound.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
 #include <thread>
 #include <vector>
@@ -115,62 +121,57 @@ void tsf_test_sf2(lab::AudioContext& ac)
     tsfNode->allNotesOff(0.f);
 }
 
+// Plays a MIDI file to the end, however long it is; the player only keeps
+// the next tenth of a second scheduled on the node.
 void tsf_test_tml(lab::AudioContext& ac)
 {
+    std::string sf2_file = std::string(synth_toy_asset_base) + "florestan-subset.sf2";
+    std::shared_ptr<TinySoundFontNode> tsfNode(new TinySoundFontNode(ac));
+    tsfNode->load_sf2(sf2_file.c_str());
+    ac.connect(ac.device(), tsfNode, 0, 0);
+
+    MidiFilePlayer player(ac, tsfNode);
     std::string midi_file = std::string(synth_toy_asset_base) + "venture.mid";
-    tml_message* TinyMidiLoader = tml_load_filename(midi_file.c_str());
-    if (!TinyMidiLoader)
-    {
-        printf("Couldn't open %s\n", midi_file.c_str());
+    if (!player.load(midi_file.c_str()))
         return;
-    }
 
+    player.play();
+    while (player.playing())
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::this_thread::sleep_for(std::chrono::seconds(2)); // wait for the last notes to release
+}
+
+// Plays an arpeggio as if from a MIDI port. The producer thread's messages
+// are delivered a few milliseconds late and unevenly, as a port's would be,
+// but carry the time they were played at, so they're heard evenly spaced.
+void tsf_test_midi_input(lab::AudioContext& ac)
+{
     std::string sf2_file = std::string(synth_toy_asset_base) + "florestan-subset.sf2";
     std::shared_ptr<TinySoundFontNode> tsfNode(new TinySoundFontNode(ac));
     tsfNode->load_sf2(sf2_file.c_str());
     ac.connect(ac.device(), tsfNode, 0, 0);
 
-    double g_Msec = 0;               //current playback time
-    tml_message* curr_MidiMessage = TinyMidiLoader;  //next message to be played
-
-    auto start = std::chrono::system_clock::now();
-
-    while (curr_MidiMessage != NULL)
+    MidiInput input(ac, tsfNode, 0.015);
+    std::thread port([&]()
     {
-        std::chrono::duration<double> elapsed_dur = std::chrono::system_clock::now() - start;
-        double elapsed_ms = elapsed_dur.count() * 1e3;
-        double until = elapsed_ms + 60000.;   // queue up anything within the next second
-
-        while (curr_MidiMessage && curr_MidiMessage->time <= until)
+        const int keys[4] = { 48, 52, 55, 60 };
+        const double step = 0.125;
+        const double start = MidiInput::now();
+        for (int i = 0; i < 64; ++i)
         {
-            double when = (float(curr_MidiMessage->time) - elapsed_ms) * 1e-3;
-            //printf("%f\n", when);
-            switch (curr_MidiMessage->type)
-            {
-            case TML_PROGRAM_CHANGE: //channel program (preset) change (special handling for 10th MIDI channel with drums)
-                tsfNode->channelSetPreset((float)when, curr_MidiMessage->channel, curr_MidiMessage->program, curr_MidiMessage->channel == 9);
-                break;
-            case TML_NOTE_ON: //play a note
-                tsfNode->channelNoteOn((float)when, curr_MidiMessage->channel, curr_MidiMessage->key, curr_MidiMessage->velocity / 127.0f);
-                break;
-            case TML_NOTE_OFF: //stop a note
-                tsfNode->channelNoteOff((float)when, curr_MidiMessage->channel, curr_MidiMessage->key);
-                break;
-            case TML_PITCH_BEND: //pitch wheel modification
-                tsfNode->channelSetPitchWheel((float)when, curr_MidiMessage->channel, curr_MidiMessage->pitch_bend);
-                break;
-            case TML_CONTROL_CHANGE: //MIDI controller messages
-                tsfNode->channelMidiControl((float)when, curr_MidiMessage->channel, curr_MidiMessage->control, curr_MidiMessage->control_value);
-                break;
-            }
-            curr_MidiMessage = curr_MidiMessage->next;
+            const double played = start + i * step;
+            const double delivered = played + (rand() % 5) * 1e-3;
+            std::this_thread::sleep_for(std::chrono::duration<double>(delivered - MidiInput::now()));
+
+            const uint8_t note_on[3] = { 0x90, uint8_t(keys[i % 4]), 100 };
+            input.send(played, note_on, 3);
+            const uint8_t note_off[3] = { 0x80, uint8_t(keys[i % 4]), 0 };
+            input.send(played + step * 0.5, note_off, 3);
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(60000));
-        break;
-    }
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(10)); // wait for the last notes
-    tml_free(TinyMidiLoader);
+    });
+    port.join();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
 }
 
 void test_template_node(lab::AudioContext& ac)
@@ -213,11 +214,244 @@ void test_pocketmod(lab::AudioContext& ac)
     std::string path = synth_toy_asset_base;
     path += "/elysium.mod";
     pocketmod->loadMOD(path.c_str());
+    pocketmod->start(0.f);
     std::this_thread::sleep_for(std::chrono::seconds(180));
 }
 
+// Renders the graph that setup connects to the recorder in an offline context,
+// as fast as the CPU allows, and writes it to path: a wav file, or raw
+// interleaved 32 bit floats if the path ends in .raw. The offline context's
+// clock starts at zero and advances with the render, so events scheduled by
+// setup play at the same times they would in a realtime context.
+// Returns the wall clock seconds spent rendering.
+double render_offline(double seconds, const std::string& path,
+    const std::function<void(lab::AudioContext&, std::shared_ptr<RecorderNode>)>& setup)
+{
+    AudioStreamConfig offlineConfig;
+    offlineConfig.device_index = 0;
+    offlineConfig.desired_samplerate = 44100.f;
+    offlineConfig.desired_channels = 2;
+
+    std::unique_ptr<lab::AudioContext> context = lab::MakeOfflineAudioContext(offlineConfig, seconds * 1000.);
+    lab::AudioContext& ac = *context.get();
+
+    std::shared_ptr<RecorderNode> recorder(new RecorderNode(ac, offlineConfig));
+    context->addAutomaticPullNode(recorder);
+    recorder->startRecording();
+    setup(ac, recorder);
+
+    std::mutex complete_mutex;
+    std::condition_variable complete_cv;
+    bool complete = false;
+    context->offlineRenderCompleteCallback = [&]()
+    {
+        recorder->stopRecording();
+        std::lock_guard<std::mutex> lock(complete_mutex);
+        complete = true;
+        complete_cv.notify_one();
+    };
+
+    // rendering happens on its own thread, and has to take the graph lock,
+    // so it's started only once setup is done changing the graph
+    auto start = std::chrono::steady_clock::now();
+    context->startOfflineRendering();
+    {
+        std::unique_lock<std::mutex> lock(complete_mutex);
+        complete_cv.wait(lock, [&] { return complete; });
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".raw") == 0)
+    {
+        std::unique_ptr<AudioBus> bus = recorder->createBusFromRecording(false);
+        FILE* f = bus ? fopen(path.c_str(), "wb") : nullptr;
+        if (!f)
+        {
+            printf("Couldn't write %s\n", path.c_str());
+            return elapsed.count();
+        }
+
+        const int channels = bus->numberOfChannels();
+        std::vector<float> frame(channels);
+        for (int i = 0; i < bus->length(); ++i)
+        {
+            for (int c = 0; c < channels; ++c)
+                frame[c] = bus->channel(c)->data()[i];
+            fwrite(frame.data(), sizeof(float), channels, f);
+        }
+        fclose(f);
+    }
+    else if (!recorder->writeRecordingToWav(path, false))
+    {
+        printf("Couldn't write %s\n", path.c_str());
+    }
+
+    return elapsed.count();
+}
+
+struct OfflineResult
+{
+    double seconds = 0;     // of audio rendered
+    double elapsed = 0;     // wall clock seconds, zero if the render failed
+};
+
+OfflineResult offline_pocketmod(const std::string& mod_path, const std::string& out_path)
+{
+    std::shared_ptr<PocketModSong> song = PocketModNode::loadSong(mod_path.c_str());
+    if (!song)
+        return {};
+
+    // play the song through once
+    double seconds = PocketModNode::duration(song);
+    std::shared_ptr<PocketModNode> pocketmod;
+    double elapsed = render_offline(seconds, out_path, [&](lab::AudioContext& ac, std::shared_ptr<RecorderNode> recorder)
+    {
+        pocketmod.reset(new PocketModNode(ac));
+        pocketmod->setLoopLimit(0);
+        pocketmod->play(song);
+        pocketmod->start(0.f);
+        ac.connect(recorder, pocketmod, 0, 0);
+    });
+
+    printf("%s: %.1f s in %.3f s, %.1fx realtime\n", out_path.c_str(), seconds, elapsed, seconds / elapsed);
+    return { seconds, elapsed };
+}
+
+OfflineResult offline_tml(const std::string& midi_path, const std::string& sf2_path, const std::string& out_path)
+{
+    std::shared_ptr<MidiSong> song = MidiSong::load(midi_path.c_str());
+    if (!song)
+        return {};
+
+    // leave a couple of seconds for the last notes to release
+    double seconds = song->duration + 2.;
+
+    std::shared_ptr<TinySoundFontNode> tsfNode;
+    double elapsed = render_offline(seconds, out_path, [&](lab::AudioContext& ac, std::shared_ptr<RecorderNode> recorder)
+    {
+        tsfNode.reset(new TinySoundFontNode(ac));
+        tsfNode->load_sf2(sf2_path.c_str());
+        ac.connect(recorder, tsfNode, 0, 0);
+
+        // the node steps through the song itself as it renders
+        tsfNode->playMidi(0, song);
+    });
+
+    printf("%s: %.1f s in %.3f s, %.1fx realtime\n", out_path.c_str(), seconds, elapsed, seconds / elapsed);
+    return { seconds, elapsed };
+}
+
+OfflineResult offline_file(const std::string& in_path, const std::string& out_path, const std::string& sf2_path)
+{
+    if (in_path.size() > 4 && in_path.compare(in_path.size() - 4, 4, ".mid") == 0)
+        return offline_tml(in_path, sf2_path, out_path);
+    return offline_pocketmod(in_path, out_path);
+}
+
+// LabSynthToy --offline <song.mod|song.mid> <out.wav|out.raw> [soundfont.sf2]
+void offline_render(int argc, char *argv[])
+{
+    const std::string in_path = argv[2];
+    const std::string out_path = argv[3];
+    const std::string sf2_path = argc > 4 ? argv[4] : std::string(synth_toy_asset_base) + "florestan-subset.sf2";
+    offline_file(in_path, out_path, sf2_path);
+}
+
+// LabSynthToy --batch <out_dir> [-j threads] [--sf2 soundfont.sf2] <songs...>
+// Renders each song to <out_dir>/<name>.wav, or to <name>-<n>.wav for the nth
+// song given when several share a name. Every worker thread renders one
+// song at a time in an offline context of its own; parsed MOD files and sound
+// fonts are shared read-only between them through the nodes' caches.
+void batch_render(int argc, char *argv[])
+{
+    const std::string out_dir = argv[2];
+    std::string sf2_path = std::string(synth_toy_asset_base) + "florestan-subset.sf2";
+    int jobs = std::max(1, (int) std::thread::hardware_concurrency());
+    std::vector<std::string> inputs;
+    for (int i = 3; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            jobs = std::max(1, atoi(argv[++i]));
+        else if (arg == "--sf2" && i + 1 < argc)
+            sf2_path = argv[++i];
+        else
+            inputs.push_back(arg);
+    }
+
+    // named up front, so that no two workers ever write the same file
+    std::vector<std::string> names;
+    std::map<std::string, int> name_counts;
+    for (const std::string& in_path : inputs)
+    {
+        size_t name_start = in_path.find_last_of("/\\");
+        name_start = name_start == std::string::npos ? 0 : name_start + 1;
+        size_t name_end = in_path.find_last_of('.');
+        name_end = name_end == std::string::npos || name_end < name_start ? in_path.size() : name_end;
+        names.push_back(in_path.substr(name_start, name_end - name_start));
+        ++name_counts[names.back()];
+    }
+    std::set<std::string> taken;
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        if (name_counts[names[i]] > 1)
+            names[i] += "-" + std::to_string(i + 1);
+
+        // only possible if another input is already called <name>-<n>
+        if (!taken.insert(names[i]).second)
+        {
+            printf("Skipping %s, %s.wav is already an output\n", inputs[i].c_str(), names[i].c_str());
+            names[i].clear();
+        }
+    }
+
+    std::atomic<size_t> next { 0 };
+    std::mutex totals_mutex;
+    double total_seconds = 0;
+    int rendered = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int j = 0; j < std::min(jobs, (int) inputs.size()); ++j)
+    {
+        workers.emplace_back([&]()
+        {
+            for (size_t i = next++; i < inputs.size(); i = next++)
+            {
+                if (names[i].empty())
+                    continue;
+
+                OfflineResult result = offline_file(inputs[i], out_dir + "/" + names[i] + ".wav", sf2_path);
+
+                std::lock_guard<std::mutex> lock(totals_mutex);
+                total_seconds += result.seconds;
+                if (result.elapsed > 0)
+                    ++rendered;
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("%d of %d songs, %.1f s of audio in %.3f s on %d threads: %.2f songs/s, %.1fx realtime\n",
+        rendered, (int) inputs.size(), total_seconds, elapsed.count(), std::min(jobs, (int) inputs.size()),
+        rendered / elapsed.count(), total_seconds / elapsed.count());
+}
+
 int main(int argc, char *argv[]) try
 {
+    if (argc > 3 && std::string(argv[1]) == "--offline")
+    {
+        offline_render(argc, argv);
+        return EXIT_SUCCESS;
+    }
+    if (argc > 3 && std::string(argv[1]) == "--batch")
+    {
+        batch_render(argc, argv);
+        return EXIT_SUCCESS;
+    }
+
     std::unique_ptr<lab::AudioContext> context;
     const auto defaultAudioDeviceConfigurations = GetDefaultAudioDeviceConfiguration();
     context = lab::MakeRealtimeAudioContext(defaultAudioDeviceConfigurations.second, defaultAudioDeviceConfigurations.first);
@@ -225,6 +459,7 @@ int main(int argc, char *argv[]) try
     //tsf_two_notes(ac);
     //tsf_test_sf2(ac);
     //tsf_test_tml(ac);
+    //tsf_test_midi_input(ac);
     //test_template_node(ac);
     //test_predictive_timing(ac);
     test_pocketmod(ac);
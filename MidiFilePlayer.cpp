@@ -0,0 +1,289 @@
+
+#include "MidiFilePlayer.h"
+#include "TinySoundFontNode.h"
+#include <LabSound/core/AudioContext.h>
+#include <LabSound/core/AudioNode.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "TinySoundFont/tml.h"
+
+namespace
+{
+    // Maps context time to song time from a point on; scale is song seconds
+    // per context second.
+    struct Timeline
+    {
+        double context_time = 0;
+        double song_time = 0;
+        double scale = 1;
+
+        double song(double t) const { return song_time + (t - context_time) * scale; }
+        double context(double s) const { return context_time + (s - song_time) / scale; }
+    };
+
+} // anon
+
+struct MidiFilePlayer::Detail
+{
+    lab::AudioContext& ac;
+    std::shared_ptr<TinySoundFontNode> synth;
+    std::shared_ptr<MidiSong> song;
+    double duration = 0;
+
+    // everything below is shared with the timer thread, under the mutex
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool quit = false;
+
+    bool playing = false;
+    double lookahead = 0.1;
+    double tempo_scale = 1;
+    double paused_at = 0;               // song time, while not playing
+    size_t next = 0;                    // the first event not yet scheduled
+    double horizon = 0;                 // context time up to which the node has been given events
+    Timeline timeline;                  // from timeline.context_time on
+    Timeline previous;                  // before it, for reporting the position
+
+    std::thread timer;
+
+    Detail(lab::AudioContext& ac, std::shared_ptr<TinySoundFontNode> synth)
+    : ac(ac), synth(synth)
+    {
+        timer = std::thread([this]() { run(); });
+    }
+
+    ~Detail()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+            stop();
+        }
+        wake.notify_one();
+        timer.join();
+    }
+
+    // changes the song time or tempo from the horizon on, since everything
+    // before it is already with the node
+    void retime(double song_time, double scale)
+    {
+        previous = timeline;
+        timeline = { horizon, song_time, scale };
+    }
+
+    // sets the synth's channels up as the song has them at a song time, by a
+    // context time ahead of the song's own events from there on
+    void chase(double song_time, double when)
+    {
+        const MidiState state = song->stateAt(song_time);
+        for (int ch = 0; ch < 16; ++ch)
+        {
+            if (!(state.used & (1 << ch)))
+                continue;
+
+            const MidiState::Channel& c = state.channels[ch];
+            synth->channelMidiControl(when, ch, TML_ALL_CTRL_OFF, 0);
+            for (int i = 0; i < MidiState::chased_count; ++i)
+            {
+                if (c.controls[i] != 0xff)
+                    synth->channelMidiControl(when, ch, MidiState::chased_controls[i], c.controls[i]);
+            }
+            synth->channelSetPreset(when, ch, c.program, ch == 9);
+            synth->channelSetPitchWheel(when, ch, c.pitch_bend);
+        }
+    }
+
+    // silences the node once the scheduled events run out; notes started
+    // before the horizon would otherwise never get their note offs
+    void stop()
+    {
+        if (playing)
+        {
+            paused_at = std::min(timeline.song(horizon), duration);
+            synth->allNotesOff(horizon);
+            playing = false;
+        }
+    }
+
+    void fill()
+    {
+        const double now = ac.predictedCurrentTime();
+        if (horizon < now)
+        {
+            // the timer fell behind; let the song slip rather than rush the
+            // events it missed out at once
+            const double song_time = timeline.song(horizon);
+            horizon = now;
+            retime(song_time, timeline.scale);
+        }
+
+        const double until = std::max(horizon, now + lookahead);
+        const double song_until = timeline.song(until);
+        const std::vector<MidiEvent>& events = song->events;
+        for (; next < events.size() && events[next].time * 1e-3 < song_until; ++next)
+            schedule(*synth, events[next], timeline.context(events[next].time * 1e-3));
+        horizon = until;
+
+        if (next == events.size())
+        {
+            playing = false;
+            paused_at = duration;
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!quit)
+        {
+            if (playing)
+                fill();
+
+            // refill well before the window runs out
+            wake.wait_for(lock, std::chrono::duration<double>(lookahead * 0.25));
+        }
+    }
+};
+
+MidiFilePlayer::MidiFilePlayer(lab::AudioContext& ac, std::shared_ptr<TinySoundFontNode> synth)
+: _detail(new Detail(ac, synth))
+{
+}
+
+MidiFilePlayer::~MidiFilePlayer()
+{
+    delete _detail;
+}
+
+bool MidiFilePlayer::load(char const*const path)
+{
+    return load(MidiSong::load(path));
+}
+
+bool MidiFilePlayer::load(std::shared_ptr<MidiSong> song)
+{
+    std::lock_guard<std::mutex> lock(_detail->mutex);
+    _detail->stop();
+    _detail->song = song;
+    _detail->next = 0;
+    _detail->paused_at = 0;
+    _detail->duration = song ? song->duration : 0;
+    return song != nullptr;
+}
+
+double MidiFilePlayer::duration() const
+{
+    std::lock_guard<std::mutex> lock(_detail->mutex);
+    return _detail->duration;
+}
+
+void MidiFilePlayer::play()
+{
+    {
+        std::lock_guard<std::mutex> lock(_detail->mutex);
+        if (_detail->playing || !_detail->song)
+            return;
+
+        if (_detail->paused_at >= _detail->duration)
+            _detail->paused_at = 0;
+
+        // start on the next quantum, rather than part way into the current one
+        lab::AudioContext& ac = _detail->ac;
+        _detail->horizon = ac.predictedCurrentTime() + lab::AudioNode::ProcessingSizeInFrames / ac.sampleRate();
+        _detail->timeline = { _detail->horizon, _detail->paused_at, _detail->tempo_scale };
+        _detail->previous = _detail->timeline;
+        _detail->next = _detail->song->find(_detail->paused_at);
+        _detail->chase(_detail->paused_at, _detail->horizon);
+        _detail->playing = true;
+    }
+    _detail->wake.notify_one();
+}
+
+void MidiFilePlayer::pause()
+{
+    std::lock_guard<std::mutex> lock(_detail->mutex);
+    _detail->stop();
+}
+
+bool MidiFilePlayer::playing() const
+{
+    std::lock_guard<std::mutex> lock(_detail->mutex);
+    return _detail->playing;
+}
+
+void MidiFilePlayer::seek(double seconds)
+{
+    std::lock_guard<std::mutex> lock(_detail->mutex);
+    seconds = std::max(0., std::min(seconds, _detail->duration));
+    if (!_detail->playing)
+    {
+        _detail->paused_at = seconds;
+        return;
+    }
+
+    _detail->synth->allNotesOff(_detail->horizon);
+    _detail->chase(seconds, _detail->horizon);
+    _detail->retime(seconds, _detail->tempo_scale);
+    _detail->next = _detail->song->find(seconds);
+}
+
+double MidiFilePlayer::position() const
+{
+    std::lock_guard<std::mutex> lock(_detail->mutex);
+    if (!_detail->playing)
+        return _detail->paused_at;
+
+    const double now = _detail->ac.predictedCurrentTime();
+    const Timeline& timeline = now < _detail->timeline.context_time ? _detail->previous : _detail->timeline;
+    return std::max(0., std::min(timeline.song(now), _detail->duration));
+}
+
+void MidiFilePlayer::setTempoScale(double scale)
+{
+    std::lock_guard<std::mutex> lock(_detail->mutex);
+    scale = std::max(scale, 0.01);
+    if (_detail->playing)
+        _detail->retime(_detail->timeline.song(_detail->horizon), scale);
+    _detail->tempo_scale = scale;
+}
+
+double MidiFilePlayer::tempoScale() const
+{
+    std::lock_guard<std::mutex> lock(_detail->mutex);
+    return _detail->tempo_scale;
+}
+
+void MidiFilePlayer::setLookahead(double seconds)
+{
+    {
+        std::lock_guard<std::mutex> lock(_detail->mutex);
+        _detail->lookahead = std::max(seconds, 0.01);
+    }
+    _detail->wake.notify_one();
+}
+
+void MidiFilePlayer::schedule(TinySoundFontNode& synth, const MidiEvent& e, double when)
+{
+    switch (e.type)
+    {
+    case TML_PROGRAM_CHANGE: //channel program (preset) change (special handling for 10th MIDI channel with drums)
+        synth.channelSetPreset(when, e.channel, e.data1, e.channel == 9);
+        break;
+    case TML_NOTE_ON: //play a note
+        synth.channelNoteOn(when, e.channel, e.data1, e.data2 / 127.0f);
+        break;
+    case TML_NOTE_OFF: //stop a note
+        synth.channelNoteOff(when, e.channel, e.data1);
+        break;
+    case TML_PITCH_BEND: //pitch wheel modification
+        synth.channelSetPitchWheel(when, e.channel, e.pitchBend());
+        break;
+    case TML_CONTROL_CHANGE: //MIDI controller messages
+        synth.channelMidiControl(when, e.channel, e.data1, e.data2);
+        break;
+    }
+}
@@ -0,0 +1,55 @@
+
+#ifndef MIDIFILEPLAYER_H
+#define MIDIFILEPLAYER_H
+
+#include "MidiSong.h"
+#include <memory>
+
+namespace lab { class AudioContext; }
+class TinySoundFontNode;
+
+// Plays a MIDI file through a TinySoundFontNode. Rather than scheduling the
+// whole file at once, a timer thread keeps only the next lookahead window of
+// events scheduled on the node, against the context's predicted current
+// time, so the node's schedule stays small however long the file is.
+//
+// Pause, seek and tempo changes take effect at the end of the window that is
+// already scheduled, so they are heard at most one lookahead late and never
+// cut into events the node already holds. Seeking and playing first restore
+// the programs, pitch wheels and controllers the song has set by then, see
+// MidiState. The player must be destroyed before the context it plays in.
+class MidiFilePlayer
+{
+    struct Detail;
+    Detail* _detail = nullptr;
+
+public:
+    MidiFilePlayer(lab::AudioContext& ac, std::shared_ptr<TinySoundFontNode> synth);
+    ~MidiFilePlayer();
+
+    // stops playback and rewinds; returns false if the file couldn't be read
+    bool load(char const*const path);
+    bool load(std::shared_ptr<MidiSong> song);
+    double duration() const;
+
+    // playing past the end of the song stops, and playing again starts over
+    void play();
+    void pause();
+    bool playing() const;
+
+    // in seconds of the song, at its own tempo
+    void seek(double seconds);
+    double position() const;
+
+    // 2 plays twice as fast
+    void setTempoScale(double scale);
+    double tempoScale() const;
+
+    // seconds of events kept scheduled ahead of the context; defaults to 0.1
+    void setLookahead(double seconds);
+
+    // schedules a single MIDI event on a node, at a context time
+    static void schedule(TinySoundFontNode& synth, const MidiEvent& e, double when);
+};
+
+#endif
@@ -0,0 +1,80 @@
+
+#include "MidiInput.h"
+#include "TinySoundFontNode.h"
+#include <LabSound/core/AudioContext.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+    // how much of each new measurement of the clock offset is taken in
+    const double offset_smoothing = 1. / 64.;
+
+    // measurements further than this from the estimate restart it, as when
+    // the device restarts and the context's clock jumps
+    const double offset_reset = 0.1;
+
+} // anon
+
+struct MidiInput::Detail
+{
+    lab::AudioContext& ac;
+    std::shared_ptr<TinySoundFontNode> synth;
+    std::atomic<double> latency;
+    int source;     // of the node's byte stream, so that other inputs keep their own running status
+
+    // context time minus host time; only the producer thread touches it
+    double offset = 0;
+    bool measured = false;
+
+    Detail(lab::AudioContext& ac, std::shared_ptr<TinySoundFontNode> synth, double latency)
+    : ac(ac), synth(synth), latency(latency), source(synth->newMidiSource())
+    {
+    }
+
+    double contextTime(double timestamp)
+    {
+        const double measurement = ac.predictedCurrentTime() - MidiInput::now();
+        if (!measured || std::fabs(measurement - offset) > offset_reset)
+        {
+            offset = measurement;
+            measured = true;
+        }
+        else
+        {
+            offset += (measurement - offset) * offset_smoothing;
+        }
+        return timestamp + offset + latency.load(std::memory_order_relaxed);
+    }
+};
+
+MidiInput::MidiInput(lab::AudioContext& ac, std::shared_ptr<TinySoundFontNode> synth, double latency)
+: _detail(new Detail(ac, synth, latency))
+{
+}
+
+MidiInput::~MidiInput()
+{
+    delete _detail;
+}
+
+double MidiInput::now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool MidiInput::send(double timestamp, const uint8_t* bytes, size_t size)
+{
+    return _detail->synth->sendMidi(_detail->contextTime(timestamp), bytes, size, _detail->source);
+}
+
+void MidiInput::setLatency(double seconds)
+{
+    _detail->latency = seconds;
+}
+
+double MidiInput::latency() const
+{
+    return _detail->latency;
+}
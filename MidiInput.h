@@ -0,0 +1,48 @@
+
+#ifndef MIDIINPUT_H
+#define MIDIINPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace lab { class AudioContext; }
+class TinySoundFontNode;
+
+// Plays live MIDI through a TinySoundFontNode with a constant latency.
+// Posting each message for "now" would land it at the start of whichever
+// quantum renders next, so its latency would jitter by up to a quantum.
+// Instead, each message carries the host time it was received at. The
+// input maps that time onto the context's clock and schedules the message a
+// fixed latency later, and the node applies it at that exact frame. Bytes
+// go to the node's raw MIDI stream, see TinySoundFontNode::sendMidi.
+//
+// The offset between the host clock and the context's clock is measured on
+// every message from predictedCurrentTime, and smoothed, since the
+// prediction itself wobbles as quanta are rendered. The latency must cover
+// that wobble and the time until the node next renders, a quantum or two.
+// Messages that arrive later than that still play, as late events.
+class MidiInput
+{
+    struct Detail;
+    Detail* _detail = nullptr;
+
+public:
+    MidiInput(lab::AudioContext& ac, std::shared_ptr<TinySoundFontNode> synth, double latency = 0.01);
+    ~MidiInput();
+
+    // The host clock timestamps are taken from, in seconds; a steady clock
+    static double now();
+
+    // Plays MIDI bytes received at a time: one message or several, with
+    // running status continuing from the last send of this input; other
+    // inputs on the same node keep their own. Call it from one producer
+    // thread at a time. Returns false if the node's stream is full.
+    bool send(double timestamp, const uint8_t* bytes, size_t size);
+
+    // Seconds from a message's timestamp to when it is heard
+    void setLatency(double seconds);
+    double latency() const;
+};
+
+#endif
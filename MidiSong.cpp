@@ -0,0 +1,162 @@
+
+#include "MidiSong.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#define TML_IMPLEMENTATION
+#include "TinySoundFont/tml.h"
+
+namespace
+{
+    std::shared_ptr<MidiSong> convert(tml_message* messages)
+    {
+        std::shared_ptr<MidiSong> song(new MidiSong());
+        for (tml_message* msg = messages; msg; msg = msg->next)
+        {
+            switch (msg->type)
+            {
+            case TML_SET_TEMPO:
+                song->tempos.push_back({ msg->time, (uint32_t) tml_get_tempo_value(msg) });
+                break;
+            case TML_PITCH_BEND:
+                song->events.push_back({ msg->time, msg->type, msg->channel,
+                    uint8_t(msg->pitch_bend & 0x7f), uint8_t((msg->pitch_bend >> 7) & 0x7f) });
+                break;
+            case TML_NOTE_ON:
+            case TML_NOTE_OFF:
+            case TML_CONTROL_CHANGE:
+            case TML_PROGRAM_CHANGE:
+                song->events.push_back({ msg->time, msg->type, msg->channel,
+                    uint8_t(msg->key), uint8_t(msg->velocity) });
+                break;
+            }
+        }
+
+        unsigned int length_ms = 0;
+        tml_get_info(messages, nullptr, nullptr, nullptr, nullptr, &length_ms);
+        tml_free(messages);
+
+        // tml merges the tracks in time order already; this only guarantees it
+        auto earlier = [](const MidiEvent& a, const MidiEvent& b) { return a.time < b.time; };
+        std::stable_sort(song->events.begin(), song->events.end(), earlier);
+        song->events.shrink_to_fit();
+
+        if (!song->events.empty())
+            length_ms = std::max(length_ms, song->events.back().time);
+        song->duration = length_ms * 1e-3;
+
+        const uint32_t whole_seconds = length_ms / 1000 + 1;
+        song->second_starts.reserve(whole_seconds);
+        song->second_states.reserve(whole_seconds);
+        MidiState state;
+        size_t i = 0;
+        for (uint32_t s = 0; s < whole_seconds; ++s)
+        {
+            for (; i < song->events.size() && song->events[i].time < s * 1000; ++i)
+                state.update(song->events[i]);
+            song->second_starts.push_back(uint32_t(i));
+            song->second_states.push_back(state);
+        }
+        return song;
+    }
+
+} // anon
+
+const uint8_t MidiState::chased_controls[MidiState::chased_count] = {
+    TML_BANK_SELECT_MSB, TML_BANK_SELECT_LSB, TML_MODULATIONWHEEL_MSB, TML_VOLUME_MSB,
+    TML_PAN_MSB, TML_EXPRESSION_MSB, TML_SUSTAIN_SWITCH };
+
+void MidiState::update(const MidiEvent& e)
+{
+    Channel& c = channels[e.channel & 15];
+    used |= uint16_t(1 << (e.channel & 15));
+    switch (e.type)
+    {
+    case TML_PROGRAM_CHANGE:
+        c.program = e.data1;
+        break;
+    case TML_PITCH_BEND:
+        c.pitch_bend = uint16_t(e.pitchBend());
+        break;
+    case TML_CONTROL_CHANGE:
+        if (e.data1 == TML_ALL_CTRL_OFF)
+        {
+            // as the synth does, back to the defaults; the program stays
+            for (uint8_t& value : c.controls)
+                value = 0xff;
+            c.pitch_bend = 8192;
+            break;
+        }
+        for (int i = 0; i < chased_count; ++i)
+        {
+            if (chased_controls[i] == e.data1)
+                c.controls[i] = e.data2;
+        }
+        break;
+    }
+}
+
+size_t MidiSong::find(double seconds) const
+{
+    if (seconds <= 0)
+        return 0;
+
+    const double ms = std::ceil(seconds * 1e3);
+    const size_t second = size_t(ms * 1e-3);
+    if (second >= second_starts.size())
+        return events.size();
+
+    // only the events of that second need searching
+    auto begin = events.begin() + second_starts[second];
+    auto end = second + 1 < second_starts.size() ? events.begin() + second_starts[second + 1] : events.end();
+    auto it = std::lower_bound(begin, end, uint32_t(ms),
+        [](const MidiEvent& e, uint32_t time) { return e.time < time; });
+    return size_t(it - events.begin());
+}
+
+MidiState MidiSong::stateAt(double seconds) const
+{
+    if (second_states.empty() || seconds <= 0)
+        return MidiState();
+
+    const size_t second = std::min(second_states.size() - 1, size_t(seconds));
+    MidiState state = second_states[second];
+    const size_t end = find(seconds);
+    for (size_t i = second_starts[second]; i < end; ++i)
+        state.update(events[i]);
+    return state;
+}
+
+double MidiSong::bpm(double seconds) const
+{
+    const double ms = seconds * 1e3;
+    auto it = std::upper_bound(tempos.begin(), tempos.end(), ms,
+        [](double time, const MidiTempo& t) { return time < t.time; });
+    if (it == tempos.begin() || !(it - 1)->quarter_us)
+        return 120.;
+
+    return 60e6 / (it - 1)->quarter_us;
+}
+
+std::shared_ptr<MidiSong> MidiSong::load(char const*const path)
+{
+    tml_message* messages = tml_load_filename(path);
+    if (!messages)
+    {
+        printf("Couldn't open %s\n", path);
+        return {};
+    }
+    return convert(messages);
+}
+
+std::shared_ptr<MidiSong> MidiSong::load(const void* data, size_t size)
+{
+    tml_message* messages = tml_load_memory(data, (int) size);
+    if (!messages)
+    {
+        printf("Couldn't load MIDI file\n");
+        return {};
+    }
+    return convert(messages);
+}
@@ -0,0 +1,82 @@
+
+#ifndef MIDISONG_H
+#define MIDISONG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// One channel message of a song, packed into eight bytes
+struct MidiEvent
+{
+    uint32_t time;          // milliseconds from the start of the song
+    uint8_t type;           // the MIDI status without its channel, as tml's TMLMessageType
+    uint8_t channel;
+    uint8_t data1;          // key, controller or program
+    uint8_t data2;          // velocity or controller value
+
+    // pitch bends keep their 14 bit value across both data bytes
+    int pitchBend() const { return data1 | (data2 << 7); }
+};
+
+// A tempo change, in microseconds per quarter note as in the file
+struct MidiTempo
+{
+    uint32_t time;          // milliseconds from the start of the song
+    uint32_t quarter_us;
+};
+
+// What a song has set on its channels by some point: each channel's
+// program, pitch wheel and the controllers below, which seeking restores
+// before playing on. Controllers the song hasn't set yet are 0xff.
+struct MidiState
+{
+    // bank select MSB and LSB, modulation, volume, pan, expression and sustain
+    static const int chased_count = 7;
+    static const uint8_t chased_controls[chased_count];
+
+    struct Channel
+    {
+        uint8_t program = 0;
+        uint16_t pitch_bend = 8192;
+        uint8_t controls[chased_count] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    };
+
+    Channel channels[16];
+    uint16_t used = 0;      // a bit for each channel the song has played on so far
+
+    // advances the state past an event
+    void update(const MidiEvent& e);
+};
+
+// A parsed MIDI file, read-only once loaded so that players and nodes on any
+// thread can share it. The messages the synth plays are kept in one time
+// sorted array rather than tml's linked list, so playing through it reads
+// memory in order, and an index of where each second starts makes finding a
+// time a short binary search. A snapshot of the channel state at the start
+// of each second lets a seek recover the state at any time by replaying at
+// most a second of events.
+struct MidiSong
+{
+    std::vector<MidiEvent> events;
+    std::vector<MidiTempo> tempos;
+    std::vector<uint32_t> second_starts;    // the first event at or after each whole second
+    std::vector<MidiState> second_states;   // the state at the start of each whole second
+    double duration = 0;                    // seconds, to the last message
+
+    // the first event at or after a time, or events.size() past the end
+    size_t find(double seconds) const;
+
+    // the state left by every event before a time
+    MidiState stateAt(double seconds) const;
+
+    // the tempo in effect at a time; 120 until the file sets one
+    double bpm(double seconds) const;
+
+    // null if the file couldn't be read
+    static std::shared_ptr<MidiSong> load(char const*const path);
+    static std::shared_ptr<MidiSong> load(const void* data, size_t size);
+};
+
+#endif
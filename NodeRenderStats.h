@@ -0,0 +1,206 @@
+
+#ifndef NODE_RENDER_STATS_H
+#define NODE_RENDER_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// A copy of a node's render counters, as returned by its renderStats(): the
+// cost of rendering it and the health of its schedule, such as late and
+// dropped events. The counters are kept on the render thread without locks,
+// and a copy can be taken from any thread; see NodeRenderCounters below.
+struct NodeRenderStats
+{
+    // Render times of single quanta. Bucket 0 counts those under a
+    // microsecond, bucket i those under 2^i microseconds, and the last
+    // bucket everything from 2^14 microseconds up.
+    static const int histogram_buckets = 16;
+
+    uint64_t quanta = 0;            // process() calls
+    uint64_t frames = 0;            // frames rendered
+    uint64_t events = 0;            // scheduled events dispatched
+    double render_seconds = 0;      // total time spent in process()
+    double max_render_seconds = 0;
+    int active_voices = 0;          // as of the last quantum
+    uint64_t histogram[histogram_buckets] = {};
+
+    // The node's schedule. Events that arrive after their time are applied
+    // at the first frame of the quantum that finds them, which makes them late
+    // by the difference; dropped events were cleared before being applied.
+    int incoming_depth = 0;         // events that arrived for the last quantum
+    int max_incoming_depth = 0;
+    int scheduled = 0;              // events still waiting after the last quantum
+    int max_scheduled = 0;
+    uint64_t late_events = 0;
+    double late_seconds = 0;        // total lateness
+    double max_late_seconds = 0;
+    uint64_t dropped_events = 0;
+
+    double meanRenderSeconds() const
+    {
+        return quanta ? render_seconds / double(quanta) : 0.;
+    }
+
+    double meanLateSeconds() const
+    {
+        return late_events ? late_seconds / double(late_events) : 0.;
+    }
+
+    // An upper bound taken from the histogram, good to a factor of two
+    double percentileRenderSeconds(double p) const
+    {
+        uint64_t total = 0;
+        for (uint64_t count : histogram)
+            total += count;
+
+        uint64_t seen = 0;
+        for (int i = 0; i < histogram_buckets - 1; ++i)
+        {
+            seen += histogram[i];
+            if (total && seen >= p * double(total))
+                return double(uint64_t(1) << i) * 1e-6;
+        }
+        return max_render_seconds;
+    }
+};
+
+// The counters behind NodeRenderStats. Only the render thread records, with
+// relaxed atomics, so any thread can take a snapshot without blocking it.
+// A snapshot taken mid-quantum may mix that quantum's counts with the last.
+// Dropped events are the exception, since schedules are also cleared from
+// the control thread.
+class NodeRenderCounters
+{
+public:
+    NodeRenderCounters()
+    {
+        reset();
+    }
+
+    void record(std::chrono::steady_clock::duration elapsed, int frames, int events, int voices)
+    {
+        const uint64_t ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+        int bucket = 0;
+        for (uint64_t us = ns / 1000; us && bucket < NodeRenderStats::histogram_buckets - 1; us >>= 1)
+            ++bucket;
+
+        _quanta.fetch_add(1, std::memory_order_relaxed);
+        _frames.fetch_add(uint64_t(frames), std::memory_order_relaxed);
+        _events.fetch_add(uint64_t(events), std::memory_order_relaxed);
+        _render_ns.fetch_add(ns, std::memory_order_relaxed);
+        _histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+        _active_voices.store(voices, std::memory_order_relaxed);
+        if (ns > _max_render_ns.load(std::memory_order_relaxed))
+            _max_render_ns.store(ns, std::memory_order_relaxed);
+    }
+
+    // once per quantum, after servicing the schedule
+    void recordQueues(int arrived, size_t scheduled)
+    {
+        _incoming_depth.store(arrived, std::memory_order_relaxed);
+        _scheduled.store(int(scheduled), std::memory_order_relaxed);
+        if (arrived > _max_incoming_depth.load(std::memory_order_relaxed))
+            _max_incoming_depth.store(arrived, std::memory_order_relaxed);
+        if (int(scheduled) > _max_scheduled.load(std::memory_order_relaxed))
+            _max_scheduled.store(int(scheduled), std::memory_order_relaxed);
+    }
+
+    // an event applied after its time
+    void recordLate(double seconds)
+    {
+        const uint64_t ns = uint64_t(seconds * 1e9);
+        _late_events.fetch_add(1, std::memory_order_relaxed);
+        _late_ns.fetch_add(ns, std::memory_order_relaxed);
+        if (ns > _max_late_ns.load(std::memory_order_relaxed))
+            _max_late_ns.store(ns, std::memory_order_relaxed);
+    }
+
+    // events discarded without being applied; the only count any thread may record
+    void recordDropped(size_t count)
+    {
+        _dropped_events.fetch_add(uint64_t(count), std::memory_order_relaxed);
+    }
+
+    NodeRenderStats snapshot() const
+    {
+        NodeRenderStats stats;
+        stats.quanta = _quanta.load(std::memory_order_relaxed);
+        stats.frames = _frames.load(std::memory_order_relaxed);
+        stats.events = _events.load(std::memory_order_relaxed);
+        stats.render_seconds = double(_render_ns.load(std::memory_order_relaxed)) * 1e-9;
+        stats.max_render_seconds = double(_max_render_ns.load(std::memory_order_relaxed)) * 1e-9;
+        stats.active_voices = _active_voices.load(std::memory_order_relaxed);
+        for (int i = 0; i < NodeRenderStats::histogram_buckets; ++i)
+            stats.histogram[i] = _histogram[i].load(std::memory_order_relaxed);
+        stats.incoming_depth = _incoming_depth.load(std::memory_order_relaxed);
+        stats.max_incoming_depth = _max_incoming_depth.load(std::memory_order_relaxed);
+        stats.scheduled = _scheduled.load(std::memory_order_relaxed);
+        stats.max_scheduled = _max_scheduled.load(std::memory_order_relaxed);
+        stats.late_events = _late_events.load(std::memory_order_relaxed);
+        stats.late_seconds = double(_late_ns.load(std::memory_order_relaxed)) * 1e-9;
+        stats.max_late_seconds = double(_max_late_ns.load(std::memory_order_relaxed)) * 1e-9;
+        stats.dropped_events = _dropped_events.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // may be called from any thread; a quantum in flight is still counted
+    void reset()
+    {
+        _quanta.store(0, std::memory_order_relaxed);
+        _frames.store(0, std::memory_order_relaxed);
+        _events.store(0, std::memory_order_relaxed);
+        _render_ns.store(0, std::memory_order_relaxed);
+        _max_render_ns.store(0, std::memory_order_relaxed);
+        _active_voices.store(0, std::memory_order_relaxed);
+        for (auto& count : _histogram)
+            count.store(0, std::memory_order_relaxed);
+        _incoming_depth.store(0, std::memory_order_relaxed);
+        _max_incoming_depth.store(0, std::memory_order_relaxed);
+        _scheduled.store(0, std::memory_order_relaxed);
+        _max_scheduled.store(0, std::memory_order_relaxed);
+        _late_events.store(0, std::memory_order_relaxed);
+        _late_ns.store(0, std::memory_order_relaxed);
+        _max_late_ns.store(0, std::memory_order_relaxed);
+        _dropped_events.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> _quanta;
+    std::atomic<uint64_t> _frames;
+    std::atomic<uint64_t> _events;
+    std::atomic<uint64_t> _render_ns;
+    std::atomic<uint64_t> _max_render_ns;
+    std::atomic<int> _active_voices;
+    std::atomic<uint64_t> _histogram[NodeRenderStats::histogram_buckets];
+    std::atomic<int> _incoming_depth;
+    std::atomic<int> _max_incoming_depth;
+    std::atomic<int> _scheduled;
+    std::atomic<int> _max_scheduled;
+    std::atomic<uint64_t> _late_events;
+    std::atomic<uint64_t> _late_ns;
+    std::atomic<uint64_t> _max_late_ns;
+    std::atomic<uint64_t> _dropped_events;
+};
+
+// Times a process() call from construction to destruction, so every return
+// path is counted. The caller fills in events and voices as it goes.
+struct NodeRenderTimer
+{
+    NodeRenderCounters& counters;
+    int frames;
+    int events = 0;
+    int voices = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    NodeRenderTimer(NodeRenderCounters& counters, int frames) : counters(counters), frames(frames) {}
+
+    ~NodeRenderTimer()
+    {
+        counters.record(std::chrono::steady_clock::now() - start, frames, events, voices);
+    }
+};
+
+#endif
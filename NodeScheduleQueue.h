@@ -0,0 +1,21 @@
+
+#ifndef NODE_SCHEDULE_QUEUE_H
+#define NODE_SCHEDULE_QUEUE_H
+
+#include <cstddef>
+#include <queue>
+
+// The nodes' schedules, as a priority queue whose storage is reserved when
+// the node is made. The render thread moves events into it every quantum,
+// and only allocates once more events are waiting than it has ever held.
+template <typename T>
+class NodeScheduleQueue : public std::priority_queue<T>
+{
+public:
+    explicit NodeScheduleQueue(size_t reserved = 256)
+    {
+        this->c.reserve(reserved);
+    }
+};
+
+#endif
@@ -0,0 +1,164 @@
+
+#include "NodeTrace.h"
+
+#if defined(LABSYNTH_TRACE)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // rings outlive their threads, so a dump still shows threads that have exited
+    std::mutex s_rings_mutex;
+    std::vector<std::unique_ptr<NodeTraceRing>> s_rings;
+
+    // rings set aside by reserveThreads, used in turn as a circular buffer;
+    // a slot is only refilled once the ring in it has been claimed
+    const int max_spare_rings = 16;
+    std::atomic<NodeTraceRing*> s_spare_rings[max_spare_rings];
+    std::atomic<int> s_spare_count { 0 };   // rings ever set aside
+    std::atomic<int> s_spare_claimed { 0 }; // of those, rings claimed by a thread
+
+    // the caller holds s_rings_mutex
+    NodeTraceRing* add_ring()
+    {
+        s_rings.emplace_back(new NodeTraceRing());
+        s_rings.back()->tid = int(s_rings.size());
+        return s_rings.back().get();
+    }
+
+    // a tick count and the time it was taken, for converting ticks to time
+    struct NodeTraceClock
+    {
+        uint64_t ticks;
+        std::chrono::steady_clock::time_point time;
+
+        static NodeTraceClock now()
+        {
+            return { NodeTrace::ticks(), std::chrono::steady_clock::now() };
+        }
+    };
+
+    NodeTraceClock s_epoch = NodeTraceClock::now();
+
+    void write_name(FILE* f, const char* name)
+    {
+        for (const char* c = name ? name : "?"; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', f);
+            if ((unsigned char) *c >= ' ')
+                fputc(*c, f);
+        }
+    }
+}
+
+NodeTraceRing* NodeTrace::allocateRing()
+{
+    // the slot is read before claiming it, since it may be refilled right after
+    int claimed = s_spare_claimed.load(std::memory_order_acquire);
+    while (claimed < s_spare_count.load(std::memory_order_acquire))
+    {
+        NodeTraceRing* ring = s_spare_rings[claimed % max_spare_rings].load(std::memory_order_relaxed);
+        if (s_spare_claimed.compare_exchange_weak(claimed, claimed + 1, std::memory_order_acq_rel))
+            return ring;
+    }
+
+    std::lock_guard<std::mutex> lock(s_rings_mutex);
+    return add_ring();
+}
+
+void NodeTrace::nameThread(const char* name)
+{
+    threadRing()->thread_name.store(name, std::memory_order_relaxed);
+}
+
+void NodeTrace::reserveThreads(int count)
+{
+    // the calling thread's own ring first, so that it can't claim one of these
+    threadRing();
+
+    std::lock_guard<std::mutex> lock(s_rings_mutex);
+    count = std::min(count, max_spare_rings);
+    for (;;)
+    {
+        const int spares = s_spare_count.load(std::memory_order_relaxed);
+        if (spares - s_spare_claimed.load(std::memory_order_acquire) >= count)
+            break;
+
+        s_spare_rings[spares % max_spare_rings].store(add_ring(), std::memory_order_relaxed);
+        s_spare_count.store(spares + 1, std::memory_order_release);
+    }
+}
+
+bool NodeTrace::writeChromeJson(const std::string& path)
+{
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+    {
+        printf("Couldn't write %s\n", path.c_str());
+        return false;
+    }
+
+    // microseconds per tick, measured over the life of the trace so far
+    const NodeTraceClock end = NodeTraceClock::now();
+    const double elapsed_us = std::chrono::duration<double, std::micro>(end.time - s_epoch.time).count();
+    const double us_per_tick = end.ticks > s_epoch.ticks ? elapsed_us / double(end.ticks - s_epoch.ticks) : 1e-3;
+
+    std::vector<NodeTraceRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(s_rings_mutex);
+        for (auto& ring : s_rings)
+            rings.push_back(ring.get());
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    std::vector<NodeTraceEvent> events;
+    for (NodeTraceRing* ring : rings)
+    {
+        if (const char* name = ring->thread_name.load(std::memory_order_relaxed))
+        {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", first ? "" : ",\n", ring->tid);
+            write_name(f, name);
+            fprintf(f, "\"}}");
+            first = false;
+        }
+
+        // copy the newest events, then keep only those the owning thread
+        // can't have overwritten while they were being copied. The writer
+        // may already be part way into slot head_after, which is where
+        // event head_after - capacity was, so that one is dropped too
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        const uint64_t begin = head > NodeTraceRing::capacity ? head - NodeTraceRing::capacity : 0;
+        events.clear();
+        for (uint64_t i = begin; i < head; ++i)
+            events.push_back(ring->events[i & (NodeTraceRing::capacity - 1)]);
+
+        const uint64_t head_after = ring->head.load(std::memory_order_acquire);
+        const uint64_t valid = head_after + 1 > NodeTraceRing::capacity ? head_after + 1 - NodeTraceRing::capacity : 0;
+        const size_t skip = size_t(std::min<uint64_t>(events.size(), valid > begin ? valid - begin : 0));
+
+        for (size_t i = skip; i < events.size(); ++i)
+        {
+            const NodeTraceEvent& e = events[i];
+            const double ts = (double(int64_t(e.ticks - s_epoch.ticks))) * us_per_tick;
+            fprintf(f, "%s{\"name\":\"", first ? "" : ",\n");
+            write_name(f, e.name);
+            fprintf(f, "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d", e.phase, ts, ring->tid);
+            if (e.phase == 'i')
+                fprintf(f, ",\"s\":\"t\",\"args\":{\"value\":%lld}", (long long) e.value);
+            fprintf(f, "}");
+            first = false;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return true;
+}
+
+#endif
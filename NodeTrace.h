@@ -0,0 +1,138 @@
+
+#ifndef NODE_TRACE_H
+#define NODE_TRACE_H
+
+// Tracing of what the nodes do on the render thread, for lining up xruns
+// with their cause. Built only with LABSYNTH_TRACE defined (the CMake option
+// LABSYNTHTOY_TRACE); otherwise the macros below compile to nothing.
+//
+//     NODE_TRACE_SCOPE("PocketMod process");          // a span to the end of the scope
+//     NODE_TRACE_INSTANT("PocketMod event", command);  // a point in time, with a value
+//
+// Names must be string literals, or otherwise outlive the trace. Each thread
+// records into a ring of its own, keeping its most recent events, so
+// recording takes no locks. A ring is about a megabyte, so a render thread
+// should take one set aside by NodeTrace::reserveThreads before it starts;
+// otherwise its first event allocates one, under a lock. A span costs two reads
+// of the CPU's time stamp counter and two stores, and the counter read
+// dominates. NodeTrace::writeChromeJson dumps every thread's ring from any
+// non-realtime thread, in the Chrome trace event format that
+// chrome://tracing and Perfetto both open. Without tracing built in,
+// nameThread does nothing and writeChromeJson fails.
+
+#if defined(LABSYNTH_TRACE)
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+    #include <intrin.h>
+#else
+    #include <chrono>
+#endif
+
+struct NodeTraceEvent
+{
+    uint64_t ticks;
+    const char* name;
+    int64_t value;
+    char phase;         // 'B'egin, 'E'nd or 'i'nstant, as in the Chrome format
+};
+
+struct NodeTraceRing
+{
+    static const uint64_t capacity = 1 << 15;
+
+    std::atomic<uint64_t> head { 0 };   // events ever recorded; only the owning thread writes
+    int tid = 0;
+    std::atomic<const char*> thread_name { nullptr };
+    NodeTraceEvent events[capacity];
+};
+
+class NodeTrace
+{
+public:
+    // the time stamp counter where there is one, converted to time when dumped
+    static uint64_t ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        return __rdtsc();
+#else
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    static void record(const char* name, char phase, int64_t value = 0)
+    {
+        NodeTraceRing* ring = threadRing();
+        const uint64_t head = ring->head.load(std::memory_order_relaxed);
+        ring->events[head & (NodeTraceRing::capacity - 1)] = { ticks(), name, value, phase };
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    // labels the calling thread in the trace, and allocates its ring now
+    // rather than on its first event
+    static void nameThread(const char* name);
+
+    // sets rings aside until at least count are waiting for threads that
+    // haven't recorded yet, such as the render thread of a context about to
+    // start, which then claims one without locking or allocating
+    static void reserveThreads(int count);
+
+    // events recorded while writing may be missing from the dump
+    static bool writeChromeJson(const std::string& path);
+
+private:
+    static NodeTraceRing* threadRing()
+    {
+        static thread_local NodeTraceRing* ring = nullptr;
+        if (!ring)
+            ring = allocateRing();
+        return ring;
+    }
+
+    static NodeTraceRing* allocateRing();
+};
+
+struct NodeTraceScope
+{
+    const char* name;
+
+    explicit NodeTraceScope(const char* name) : name(name)
+    {
+        NodeTrace::record(name, 'B');
+    }
+
+    ~NodeTraceScope()
+    {
+        NodeTrace::record(name, 'E');
+    }
+};
+
+#define NODE_TRACE_CONCAT_(a, b) a##b
+#define NODE_TRACE_CONCAT(a, b) NODE_TRACE_CONCAT_(a, b)
+#define NODE_TRACE_SCOPE(name) NodeTraceScope NODE_TRACE_CONCAT(node_trace_scope_, __LINE__)(name)
+#define NODE_TRACE_INSTANT(name, value) NodeTrace::record(name, 'i', int64_t(value))
+
+#else
+
+#include <string>
+
+class NodeTrace
+{
+public:
+    static void nameThread(const char*) {}
+    static void reserveThreads(int) {}
+    static bool writeChromeJson(const std::string&) { return false; }
+};
+
+#define NODE_TRACE_SCOPE(name) ((void) 0)
+#define NODE_TRACE_INSTANT(name, value) ((void) 0)
+
+#endif
+
+#endif
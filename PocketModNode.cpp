@@ -1,6 +1,9 @@
 
 
 #include "PocketModNode.h"
+#include "NodeScheduleQueue.h"
+#include "NodeTrace.h"
+#include "RealtimeCheck.h"
 #include <LabSound/core/AudioBus.h>
 #include <LabSound/core/AudioContext.h>
 #include <LabSound/core/AudioNodeOutput.h>
@@ -12,14 +15,396 @@
 
 #include "concurrentqueue.h"
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <queue>
+#include <string>
+
+#if defined(_WIN32)
+    #if !defined(WIN32_LEAN_AND_MEAN)
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #if !defined(NOMINMAX)
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 using namespace lab;
 
+
+
+namespace {
+
+// A read-only view of a MOD file. pocketmod never writes to the song data,
+// so the file is memory mapped rather than copied.
+struct MappedFile
+{
+    const void* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { unmap(); }
+
+    bool map(const char* path)
+    {
+        unmap();
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER file_size;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (mapping)
+        {
+            // the view keeps the mapping alive after the handles are closed
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            size = data ? (size_t) file_size.QuadPart : 0;
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* view = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED)
+            {
+                data = view;
+                size = (size_t) st.st_size;
+            }
+        }
+        close(fd);
+#endif
+        return data != nullptr;
+    }
+
+    void unmap()
+    {
+        if (!data)
+            return;
+
+#if defined(_WIN32)
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<void*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+};
+
+// Advances a context without mixing. Returns the number of frames advanced.
+uint64_t skipFrames(pocketmod_context* c, uint64_t frames)
+{
+    uint64_t skipped = 0;
+    while (skipped < frames)
+    {
+        int n = (int) std::min<uint64_t>(frames - skipped, 1 << 30);
+        int advanced = pocketmod_advance(c, n);
+        if (advanced <= 0)
+            break;
+        skipped += advanced;
+    }
+    return skipped;
+}
+
+// Advances a context to the first tick of a line in its current pattern.
+// Returns the number of frames advanced.
+uint64_t skipToLine(pocketmod_context* c, int line)
+{
+    const int pattern = c->pattern;
+    uint64_t frames = 0;
+
+    // a line can last at most 31 ticks plus 15 lines of pattern delay, and
+    // pattern loops can replay up to 15 times, so bound the search generously
+    for (int ticks = 0; ticks < 64 * 32 * 16 * 16; ++ticks)
+    {
+        if ((c->line == line && c->tick == 0) || c->pattern != pattern)
+            break;
+
+        // advance exactly the remainder of the tick, as pocketmod_advance would
+        int num = (int) (c->samples_per_tick - c->sample);
+        frames += skipFrames(c, num + !num);
+    }
+    return frames;
+}
+
+} // anon
+
+// Snapshots of the playback state at the start of each entry in a song's
+// pattern order, in playback order, up to the point where the song loops.
+// The snapshots depend on the sample rate.
+struct PocketModSongIndex
+{
+    struct Entry
+    {
+        int order;
+        uint64_t frame;
+        size_t offset;      // of the snapshot in contexts
+    };
+
+    int rate = 0;
+    uint64_t length = 0;    // frames until the song loops, or until the cap below
+    std::vector<Entry> entries;
+
+    // snapshots only cover the song's own channels, see pocketmod_context_size
+    size_t context_size = 0;
+    std::vector<unsigned char> contexts;
+
+    void add(const pocketmod_context& c, uint64_t frame)
+    {
+        size_t offset = contexts.size();
+        contexts.resize(offset + context_size);
+        memcpy(&contexts[offset], &c, context_size);
+        entries.push_back({ c.pattern, frame, offset });
+    }
+
+    // copies the snapshot into a context with room for at least the song's channels
+    void restore(const Entry& e, pocketmod_context* c) const
+    {
+        memcpy(c, &contexts[e.offset], context_size);
+    }
+
+    // songs that never loop are indexed up to half an hour
+    static constexpr int max_seconds = 30 * 60;
+
+    const Entry* find_order(int order) const
+    {
+        for (const Entry& e : entries)
+            if (e.order == order)
+                return &e;
+        return nullptr;
+    }
+
+    const Entry* find_frame(uint64_t frame) const
+    {
+        auto i = std::upper_bound(entries.begin(), entries.end(), frame,
+            [](uint64_t f, const Entry& e) { return f < e.frame; });
+        return i == entries.begin() ? nullptr : &*(i - 1);
+    }
+};
+
+// The parsed, read-only part of a MOD file. Any number of playbacks on any
+// number of nodes may share one song.
+struct PocketModSong
+{
+    MappedFile file;    // empty if the caller owns the song data
+    std::vector<float> unrolled_samples;
+    pocketmod_song song;
+
+    std::mutex index_mutex;
+    std::vector<std::unique_ptr<PocketModSongIndex>> indices;   // one per sample rate
+
+    PocketModSong()
+    {
+        memset(&song, 0, sizeof(pocketmod_song));
+    }
+
+    bool load(const void* data, size_t size, bool unroll)
+    {
+        if (!pocketmod_load(&song, data, (int) size))
+        {
+            printf("Couldn't load MOD file\n");
+            return false;
+        }
+
+        if (unroll)
+        {
+            unrolled_samples.resize(pocketmod_unrolled_size(&song) / sizeof(float));
+            pocketmod_unroll_samples(&song, unrolled_samples.data(),
+                (int) (unrolled_samples.size() * sizeof(float)));
+        }
+        return true;
+    }
+
+    // Returns the seek index for a sample rate, building it on first use.
+    // pocketmod_advance stops at every new pattern, which is exactly where
+    // the snapshots are taken.
+    const PocketModSongIndex* index(int rate)
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        for (auto& i : indices)
+            if (i->rate == rate)
+                return i.get();
+
+        std::unique_ptr<PocketModSongIndex> index(new PocketModSongIndex());
+        index->rate = rate;
+        index->context_size = pocketmod_context_size(song.num_channels);
+
+        pocketmod_context c;
+        if (!pocketmod_init(&c, &song, rate))
+            return nullptr;
+
+        const uint64_t limit = (uint64_t) rate * PocketModSongIndex::max_seconds;
+        uint64_t frame = 0;
+        index->add(c, frame);
+        while (frame < limit)
+        {
+            int advanced = pocketmod_advance(&c, (int) (limit - frame));
+            if (advanced <= 0)
+                break;
+
+            frame += advanced;
+            if (pocketmod_loop_count(&c) > 0)
+                break;
+
+            if (c.line == 0 && c.tick == 0)
+                index->add(c, frame);
+        }
+        index->length = frame;
+
+        indices.push_back(std::move(index));
+        return indices.back().get();
+    }
+};
+
+namespace {
+
+// Songs loaded by path, shared until the last playback referencing them is released
+std::mutex s_song_cache_mutex;
+std::map<std::string, std::weak_ptr<PocketModSong>> s_song_cache;
+
+// Everything the render thread needs to play one song. A playback is built
+// on the control thread, handed to the render thread through a queue, and
+// handed back through another queue once the render thread stops using it,
+// so that the song is never released on the render thread.
+struct PocketModPlayback
+{
+    std::shared_ptr<PocketModSong> song;
+    uint64_t frame = 0;     // position in the song
+    int queued_id = 0;      // its entry in the node's queued songs, until it plays
+
+    // the context lives in the derived class, sized for the song's channel
+    // count, and render is the matching specialization of pocketmod_render
+    pocketmod_context* context = nullptr;
+    int (*render)(pocketmod_context* c, void* buffer, int size) = nullptr;
+
+    virtual ~PocketModPlayback() = default;
+
+    static std::unique_ptr<PocketModPlayback> create(std::shared_ptr<PocketModSong> song);
+};
+
+// pocketmod_render with the channel count fixed at compile time, so that the
+// channel loop has a constant trip count the compiler can unroll. Channels
+// past the song's own are never triggered, so their sample stays zero.
+template <int Channels>
+int renderChannels(pocketmod_context* c, void* buffer, int buffer_size)
+{
+    int samples_rendered = 0;
+    int samples_remaining = buffer_size / POCKETMOD_SAMPLE_SIZE;
+    float (*output)[2] = (float(*)[2]) buffer;
+    while (samples_remaining > 0)
+    {
+        // calculate the number of samples left in this tick
+        int num = (int) (c->samples_per_tick - c->sample);
+        num = std::min(num + !num, samples_remaining);
+
+        // render and mix 'num' samples from each channel
+        memset(output, 0, num * POCKETMOD_SAMPLE_SIZE);
+        for (int i = 0; i < Channels; ++i)
+        {
+            _pocketmod_chan* chan = &c->channels[i];
+            if (chan->sample != 0 && chan->position >= 0.0f)
+                _pocketmod_render_channel(c, chan, output[0], output[0] + 1, 2, num);
+        }
+        samples_remaining -= num;
+        samples_rendered += num;
+        output += num;
+
+        if (_pocketmod_step(c, num))
+            break;
+    }
+    return samples_rendered * POCKETMOD_SAMPLE_SIZE;
+}
+
+// A playback whose context only has room for Channels channels; a four
+// channel context is about a sixth the size of a full one. The storage is
+// shorter than a pocketmod_context, so the context pointer must only ever
+// reach the members before the channel array and the song's own channels.
+// That holds for the pocketmod_* calls, which touch num_channels channels,
+// and for this file, which copies snapshots of pocketmod_context_size bytes;
+// the context must never be copied or assigned as a whole struct.
+template <int Channels>
+struct PocketModPlaybackN : public PocketModPlayback
+{
+    static constexpr size_t context_size =
+        sizeof(pocketmod_context) - (POCKETMOD_MAX_CHANNELS - Channels) * sizeof(_pocketmod_chan);
+
+    static_assert(Channels > 0 && Channels <= POCKETMOD_MAX_CHANNELS, "unsupported channel count");
+    static_assert(offsetof(pocketmod_context, channels) + Channels * sizeof(_pocketmod_chan) <= context_size,
+        "the channel array must be the last member of pocketmod_context");
+
+    alignas(pocketmod_context) unsigned char storage[context_size];
+
+    PocketModPlaybackN()
+    {
+        memset(storage, 0, sizeof(storage));
+        context = reinterpret_cast<pocketmod_context*>(storage);
+        render = &renderChannels<Channels>;
+    }
+};
+
+std::unique_ptr<PocketModPlayback> PocketModPlayback::create(std::shared_ptr<PocketModSong> song)
+{
+    std::unique_ptr<PocketModPlayback> p;
+    const int channels = song->song.num_channels;
+    if (channels <= 4)
+        p.reset(new PocketModPlaybackN<4>());
+    else if (channels <= 8)
+        p.reset(new PocketModPlaybackN<8>());
+    else if (channels <= 16)
+        p.reset(new PocketModPlaybackN<16>());
+    else
+        p.reset(new PocketModPlaybackN<POCKETMOD_MAX_CHANNELS>());
+
+    p->song = std::move(song);
+    return p;
+}
+
+// the most channels a LabSound bus can carry
+const int max_stem_channels = 32;
+
+const int command_start = 0;
+const int command_pause = 1;
+const int command_stop = 2;
+const int command_seek = 3;
+const int command_tempo = 4;
+const int command_next = 5;
+
+// A song waiting to follow the current one, see PocketModNode::queueSong
+struct PocketModQueuedSong
+{
+    PocketModPlayback* playback;
+    double crossfade;   // seconds
+};
+
 struct PocketModNodeEvent
 {
     double when;
-    int id;
+    int command;
+    double value;
+    PocketModPlayback* playback;    // for start, stop, seek and next, prepared off the audio thread
+    int id; // id enforces total order, if two commands occur simultaneously, their total enqueue order will be respected
 
     bool operator<(const PocketModNodeEvent& rhs) const
     {
@@ -31,33 +416,597 @@ struct PocketModNodeEvent
     }
 };
 
-
+} // anon
 
 struct PocketModNode::Detail
 {
-    std::priority_queue<PocketModNodeEvent> queue;
+    NodeScheduleQueue<PocketModNodeEvent> queue;
     moodycamel::ConcurrentQueue<PocketModNodeEvent> incoming;
     lab::AudioContext* ac = nullptr;
     
     std::vector<float> pocketmod_render_buffer;
-    
-    pocketmod_context context;
-    size_t mod_size = 0;
-    char* mod_data = nullptr;
-    bool mod_playing = false;
+    std::vector<float> fade_buffer;
+
+    // the playback is only touched by the render thread once published
+    PocketModPlayback* playback = nullptr;
+    moodycamel::ConcurrentQueue<PocketModPlayback*> pending;
+    moodycamel::ConcurrentQueue<PocketModPlayback*> retired;
+
+    // the render thread retires playbacks through this producer, made here
+    // because a queue's first enqueue from a new thread allocates
+    moodycamel::ProducerToken retire_token { retired };
+
+    // songs to play when the current one ends; the render thread holds the
+    // next one aside so that it knows whether the current song should end
+    moodycamel::ConcurrentQueue<PocketModQueuedSong> queued;
+    PocketModQueuedSong next = { nullptr, 0 };
+
+    // the outgoing playback during a crossfade, rendered only until it's faded out
+    PocketModPlayback* fading = nullptr;
+    int fade_length = 0;
+    int fade_remaining = 0;
+    int fade_offset = 0;    // frame of the quantum the crossfade starts on
+
+    // the song most recently handed to the render thread, for seeking, and
+    // the songs queued after it, which the render thread may have moved on
+    // to; locked, since queries such as duration() may come from any thread
+    mutable std::mutex songs_mutex;
+    std::shared_ptr<PocketModSong> song;
+    struct QueuedEntry
+    {
+        std::shared_ptr<PocketModSong> song;
+        int id;     // the queued_id of the song's playback
+    };
+    std::vector<QueuedEntry> queued_songs;
+    std::atomic<const PocketModSong*> current { nullptr };
+    std::atomic<double> position { 0 };
 
-    Detail()
+    bool playing = false;   // render thread transport state
+
+    // the stems output is only resized on the control thread, see resizeStems
+    AudioNodeOutput* stems_output = nullptr;
+    std::atomic<bool> stems { false };
+    std::atomic<bool> stems_panned { false };
+    float* stem_channels[max_stem_channels];
+
+    std::atomic<int> interpolation { POCKETMOD_INTERPOLATE_LINEAR };
+
+    // times the song may loop before it ends, or -1 to loop forever
+    std::atomic<int> loop_limit { -1 };
+
+    // the ended callback, handed to the render thread and back as playbacks
+    // are, so that only the render thread reads it and only the control
+    // thread frees it
+    std::function<void()>* on_ended = nullptr;
+    moodycamel::ConcurrentQueue<std::function<void()>*> pending_on_ended;
+    moodycamel::ConcurrentQueue<std::function<void()>*> retired_on_ended;
+    moodycamel::ProducerToken retire_on_ended_token { retired_on_ended };
+
+    int id = 0;
+
+    // float copies of the samples with their loops unrolled, see setUnrollSamples
+    bool unroll_samples = true;
+
+    NodeRenderCounters stats;
+
+    Detail() = default;
+    ~Detail()
     {
-        memset(&context, 0, sizeof(pocketmod_context));
+        PocketModPlayback* p;
+        while (pending.try_dequeue(p))
+            delete p;
+        PocketModQueuedSong q;
+        while (queued.try_dequeue(q))
+            delete q.playback;
+        std::function<void()>* fn;
+        while (pending_on_ended.try_dequeue(fn))
+            delete fn;
+        collectRetired();
+        delete next.playback;
+        delete fading;
+        delete playback;
+        delete on_ended;
     }
-    ~Detail() = default;
 
     void clearSchedules()
     {
+        // prepared playbacks are retired rather than deleted, and through the
+        // render thread's token, since this may run on the render thread. The
+        // only other caller is the destructor, once the node is out of the graph
         PocketModNodeEvent s;
-        while (incoming.try_dequeue(s)) {}
+        size_t dropped = queue.size();
+        while (incoming.try_dequeue(s))
+        {
+            if (s.playback)
+                retired.enqueue(retire_token, s.playback);
+            ++dropped;
+        }
         while (!queue.empty())
+        {
+            if (queue.top().playback)
+                retired.enqueue(retire_token, queue.top().playback);
             queue.pop();
+        }
+        stats.recordDropped(dropped);
+    }
+
+    void schedule(float when, int command, double value, std::unique_ptr<PocketModPlayback> p = {})
+    {
+        collectRetired();
+        incoming.enqueue({ when + ac->currentTime(), command, value, p.release(), ++id });
+    }
+
+    // called from the control thread to free playbacks the render thread has
+    // let go of; a queued song's playback that never played was cancelled,
+    // so its song no longer follows the current one
+    void collectRetired()
+    {
+        PocketModPlayback* p;
+        while (retired.try_dequeue(p))
+        {
+            if (p->queued_id)
+                dropQueuedSong(p->queued_id);
+            delete p;
+        }
+        std::function<void()>* fn;
+        while (retired_on_ended.try_dequeue(fn))
+            delete fn;
+
+        pruneSongs();
+    }
+
+    // called from the control thread to drop the queued songs the render thread has moved past
+    void pruneSongs()
+    {
+        std::lock_guard<std::mutex> lock(songs_mutex);
+        const PocketModSong* c = current;
+        for (size_t i = 0; i < queued_songs.size(); ++i)
+        {
+            if (queued_songs[i].song.get() == c)
+            {
+                song = queued_songs[i].song;
+                queued_songs.erase(queued_songs.begin(), queued_songs.begin() + i + 1);
+                break;
+            }
+        }
+    }
+
+    // called from the control thread to note a song that will follow the current one
+    void addQueuedSong(PocketModPlayback& p)
+    {
+        std::lock_guard<std::mutex> lock(songs_mutex);
+        p.queued_id = ++id;
+        queued_songs.push_back({ p.song, p.queued_id });
+    }
+
+    // called from the control thread to forget a queued song that won't play
+    void dropQueuedSong(int queued_id)
+    {
+        std::lock_guard<std::mutex> lock(songs_mutex);
+        for (size_t i = 0; i < queued_songs.size(); ++i)
+        {
+            if (queued_songs[i].id == queued_id)
+            {
+                queued_songs.erase(queued_songs.begin() + i);
+                break;
+            }
+        }
+    }
+
+    // called from the render thread to switch to the most recently published playback
+    void acquirePending()
+    {
+        PocketModPlayback* p;
+        while (pending.try_dequeue(p))
+            replacePlayback(p);
+
+        std::function<void()>* fn;
+        while (pending_on_ended.try_dequeue(fn))
+        {
+            if (on_ended)
+                retired_on_ended.enqueue(retire_on_ended_token, on_ended);
+            on_ended = fn;
+        }
+    }
+
+    // the song the render thread is playing, or about to
+    std::shared_ptr<PocketModSong> currentSong() const
+    {
+        std::lock_guard<std::mutex> lock(songs_mutex);
+        const PocketModSong* c = current;
+        for (const QueuedEntry& q : queued_songs)
+        {
+            if (q.song.get() == c)
+                return q.song;
+        }
+        return song;
+    }
+
+    // a playback of a song from its start, ready to render
+    std::unique_ptr<PocketModPlayback> prepareStart(std::shared_ptr<PocketModSong> s)
+    {
+        if (!s)
+            return {};
+
+        std::unique_ptr<PocketModPlayback> p = PocketModPlayback::create(s);
+        if (!pocketmod_init(p->context, &s->song, (int) ac->sampleRate()))
+            return {};
+
+        // build the seek index now rather than on the first seek
+        s->index((int) ac->sampleRate());
+        return p;
+    }
+
+    bool publish(std::shared_ptr<PocketModSong> s)
+    {
+        std::unique_ptr<PocketModPlayback> p = prepareStart(s);
+        if (!p)
+            return false;
+
+        // pruned first, so that a queued song the render thread has moved to
+        // can't take the place of this one
+        collectRetired();
+        {
+            std::lock_guard<std::mutex> lock(songs_mutex);
+            song = std::move(s);
+        }
+        return publish(std::move(p));
+    }
+
+    bool publish(std::unique_ptr<PocketModPlayback> p)
+    {
+        if (!p)
+            return false;
+
+        collectRetired();
+        if (stems_output->numberOfChannels() != stemsWidth())
+        {
+            // resized with the playback published under the same lock, so the
+            // render thread moves to both on the same quantum
+            ContextRenderLock r(ac, "PocketModNode::publish");
+            resizeStems(r);
+            pending.enqueue(p.release());
+        }
+        else
+        {
+            pending.enqueue(p.release());
+        }
+        return true;
+    }
+
+    // whether a song's stems are panned in the current mode
+    bool stemsPanned(const PocketModSong& s) const
+    {
+        return stems_panned && s.song.num_channels * 2 <= max_stem_channels;
+    }
+
+    // the number of bus channels a song's stems take in the current mode
+    int stemChannels(const PocketModSong& s) const
+    {
+        return stemsPanned(s) ? s.song.num_channels * 2 : s.song.num_channels;
+    }
+
+    // called from the control thread; the width of the stems output, enough
+    // for the current song and every song queued after it, so the render
+    // thread never needs to resize it when one song follows another
+    int stemsWidth() const
+    {
+        if (!stems)
+            return 1;
+
+        std::lock_guard<std::mutex> lock(songs_mutex);
+        int width = song ? stemChannels(*song) : 1;
+        for (const QueuedEntry& q : queued_songs)
+            width = std::max(width, stemChannels(*q.song));
+        return width;
+    }
+
+    // called from the control thread, holding the render lock, to fit the
+    // stems output to the songs; this allocates, so it never runs in process()
+    void resizeStems(ContextRenderLock& r)
+    {
+        const int width = stemsWidth();
+        if (stems_output->numberOfChannels() != width)
+            stems_output->setNumberOfChannels(r, width);
+    }
+
+    // called from the control thread; takes the render lock only if the width changes
+    void fitStems()
+    {
+        if (stems_output->numberOfChannels() == stemsWidth())
+            return;
+
+        ContextRenderLock r(ac, "PocketModNode stems");
+        resizeStems(r);
+    }
+
+    // a playback of the current song from its start
+    std::unique_ptr<PocketModPlayback> prepareRewind()
+    {
+        return prepareStart(currentSong());
+    }
+
+    std::unique_ptr<PocketModPlayback> prepareSeek(int order, int line)
+    {
+        std::shared_ptr<PocketModSong> song = currentSong();
+        if (!song || order < 0 || order >= song->song.length || line < 0 || line > 63)
+            return {};
+
+        const int rate = (int) ac->sampleRate();
+        const PocketModSongIndex* index = song->index(rate);
+        if (!index)
+            return {};
+
+        std::unique_ptr<PocketModPlayback> p = PocketModPlayback::create(song);
+        if (const PocketModSongIndex::Entry* e = index->find_order(order))
+        {
+            index->restore(*e, p->context);
+            p->frame = e->frame;
+        }
+        else
+        {
+            // the order entry is never reached by normal playback, so start it
+            // from a fresh context, with nothing left over from the first
+            // order's opening line; there is no meaningful song time for it,
+            // so the position restarts at zero
+            _pocketmod_init_order(p->context, &song->song, rate, order);
+        }
+
+        p->frame += skipToLine(p->context, line);
+        return p;
+    }
+
+    std::unique_ptr<PocketModPlayback> prepareSeek(double seconds)
+    {
+        std::shared_ptr<PocketModSong> song = currentSong();
+        if (!song)
+            return {};
+
+        const int rate = (int) ac->sampleRate();
+        const PocketModSongIndex* index = song->index(rate);
+        if (!index)
+            return {};
+
+        uint64_t target = (uint64_t) (std::max(0.0, seconds) * rate);
+        target = std::min(target, index->length);
+
+        const PocketModSongIndex::Entry* e = index->find_frame(target);
+        if (!e)
+            return {};
+
+        std::unique_ptr<PocketModPlayback> p = PocketModPlayback::create(song);
+        index->restore(*e, p->context);
+        p->frame = e->frame + skipFrames(p->context, target - e->frame);
+        return p;
+    }
+
+    // called from the render thread to swap in a playback
+    void replacePlayback(PocketModPlayback* p)
+    {
+        NODE_TRACE_INSTANT("PocketMod swap", p ? int64_t(p->frame) : -1);
+        if (playback)
+            retired.enqueue(retire_token, playback);
+        if (p)
+            p->queued_id = 0;
+        playback = p;
+        current = p ? p->song.get() : nullptr;
+    }
+
+    // called from the render thread to move to another song at a frame of the
+    // quantum, either directly or by fading out the current one over crossfade seconds
+    void transition(PocketModPlayback* p, double crossfade, int offset)
+    {
+        if (crossfade > 0 && playback && playing)
+        {
+            if (fading)
+                retired.enqueue(retire_token, fading);
+            fading = playback;
+            fade_length = std::max(1, (int) (crossfade * ac->sampleRate()));
+            fade_remaining = fade_length;
+            fade_offset = offset;
+            playback = nullptr;
+        }
+        replacePlayback(p);
+    }
+
+    // called from the render thread when the current song ends, to move on to the next one
+    bool nextSong(int offset)
+    {
+        if (on_ended)
+        {
+            // LabSound's event queue may allocate; this happens once per song
+            NODE_REALTIME_ALLOW();
+            ac->enqueueEvent(*on_ended);
+        }
+
+        if (!next.playback)
+            return false;
+
+        transition(next.playback, next.crossfade, offset);
+        next = { nullptr, 0 };
+        queued.try_dequeue(next);
+        return true;
+    }
+
+    // called from the render thread to apply a transport command at a frame of the quantum
+    void apply(const PocketModNodeEvent& e, int offset)
+    {
+        switch (e.command)
+        {
+        case command_start:
+            // starting a song that has ended plays it again from the top
+            if (e.playback && songEnded(playback))
+                replacePlayback(e.playback);
+            else if (e.playback)
+                retired.enqueue(retire_token, e.playback);
+            playing = true;
+            break;
+        case command_pause:
+            playing = false;
+            break;
+        case command_stop:
+            playing = false;
+            if (e.playback)
+                replacePlayback(e.playback);
+            break;
+        case command_seek:
+            if (e.playback)
+                replacePlayback(e.playback);
+            break;
+        case command_next:
+            if (e.playback)
+                transition(e.playback, e.value, offset);
+            break;
+        case command_tempo:
+            // as a song's own Fxx command would, which may later override it
+            if (playback && e.value > 0)
+                playback->context->samples_per_tick = (float) (playback->context->samples_per_second / (0.4 * e.value));
+            break;
+        }
+    }
+
+    // tracker channels with a sample sounding, in the current song and any fading one
+    int activeVoices() const
+    {
+        if (!playing)
+            return 0;
+
+        int voices = 0;
+        for (const PocketModPlayback* p : { playback, fading })
+        {
+            if (!p)
+                continue;
+
+            for (int i = 0; i < p->song->song.num_channels; ++i)
+            {
+                const _pocketmod_chan& chan = p->context->channels[i];
+                if (chan.sample != 0 && chan.position >= 0.0f && chan.real_volume > 0)
+                    ++voices;
+            }
+        }
+        return voices;
+    }
+
+    bool songEnded(const PocketModPlayback* p) const
+    {
+        // with a song queued, the current one plays out once unless a loop limit says otherwise
+        int limit = loop_limit;
+        if (limit < 0 && next.playback)
+            limit = 0;
+        return p && limit >= 0 && pocketmod_loop_count(p->context) > limit;
+    }
+
+    // called from the render thread to render up to count frames of a playback,
+    // interleaved, into buffer, and each tracker channel into the stems bus from
+    // the given frame of the quantum, if there is a stems bus. Returns the number
+    // of frames rendered, which is short if stopAtEnd is set and the song ends.
+    int renderPlayback(PocketModPlayback* p, float* buffer, AudioBus* stemsBus, int offset, int count, bool stopAtEnd)
+    {
+        // applied here rather than when the playback is prepared, since seeks restore snapshots
+        pocketmod_set_interpolation(p->context, interpolation);
+
+        // the layout follows the playback's own song; the bus is sized for
+        // every song published, so this only skips stems that can't fit
+        const int channels = p->song->song.num_channels;
+        const bool panned = stemsPanned(*p->song);
+        if (stemsBus && stemsBus->numberOfChannels() < stemChannels(*p->song))
+            stemsBus = nullptr;
+
+        // pocketmod_render stops early at pattern boundaries, so keep going until the range is full
+        int frames = 0;
+        while (frames < count)
+        {
+            int rendered;
+            if (stemsBus)
+            {
+                for (int i = 0; i < (panned ? channels * 2 : channels); ++i)
+                    stem_channels[i] = stemsBus->channel(i)->mutableData() + offset + frames;
+
+                rendered = pocketmod_render_channels(p->context, stem_channels, panned, buffer + frames * 2, count - frames);
+            }
+            else
+            {
+                int bytes = p->render(p->context, buffer + frames * 2, (count - frames) * 2 * sizeof(float));
+                rendered = bytes / (2 * sizeof(float));
+            }
+            if (rendered <= 0)
+                break;
+            frames += rendered;
+
+            // pocketmod stops at each new pattern, which is where a loop is counted
+            if (stopAtEnd && songEnded(p))
+                break;
+        }
+        p->frame += frames;
+        return frames;
+    }
+
+    // called from the render thread to render frames [start, end) of the quantum,
+    // moving through the song queue as songs end
+    void render(AudioBus* outputBus, AudioBus* stemsBus, int start, int end)
+    {
+        if (!playing || start >= end)
+            return;
+
+        if (!next.playback)
+            queued.try_dequeue(next);
+
+        float* dataL = outputBus->channel(0)->mutableData();
+        float* dataR = outputBus->channel(1)->mutableData();
+
+        int offset = start;
+        while (offset < end && playback)
+        {
+            // the rest of the quantum stays silent if nothing follows, and once
+            // nothing else is scheduled, propagatesSilence lets the graph skip this node
+            if (songEnded(playback) && !nextSong(offset))
+            {
+                playing = false;
+                break;
+            }
+
+            int frames = renderPlayback(playback, pocketmod_render_buffer.data(), stemsBus, offset, end - offset, true);
+            for (int i = 0; i < frames; ++i)
+            {
+                dataL[offset + i] = pocketmod_render_buffer[i * 2];
+                dataR[offset + i] = pocketmod_render_buffer[i * 2 + 1];
+            }
+            offset += frames;
+
+            if (frames == 0 && !songEnded(playback))
+                break;
+        }
+
+        if (fading)
+            renderFade(outputBus, std::max(start, fade_offset), end);
+        fade_offset = 0;
+    }
+
+    // called from the render thread to crossfade the outgoing song into frames [start, end)
+    void renderFade(AudioBus* outputBus, int start, int end)
+    {
+        int count = std::min(end - start, fade_remaining);
+        int frames = renderPlayback(fading, fade_buffer.data(), nullptr, start, count, false);
+
+        // equal power, since the two songs are uncorrelated
+        float* dataL = outputBus->channel(0)->mutableData() + start;
+        float* dataR = outputBus->channel(1)->mutableData() + start;
+        const float quarter_turn = 1.5707963f;
+        for (int i = 0; i < frames; ++i)
+        {
+            float t = 1.f - (float) (fade_remaining - i) / fade_length;
+            float gain_in = sinf(t * quarter_turn);
+            float gain_out = cosf(t * quarter_turn);
+            dataL[i] = dataL[i] * gain_in + fade_buffer[i * 2] * gain_out;
+            dataR[i] = dataR[i] * gain_in + fade_buffer[i * 2 + 1] * gain_out;
+        }
+
+        fade_remaining -= count;
+        if (fade_remaining <= 0)
+        {
+            retired.enqueue(retire_token, fading);
+            fading = nullptr;
+        }
     }
 };
 
@@ -67,6 +1016,12 @@ PocketModNode::PocketModNode(AudioContext& ac)
 {
     _detail->ac = &ac;
     addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 2)));
+    addOutput(std::unique_ptr<AudioNodeOutput>(new AudioNodeOutput(this, 1)));     // stems
+    _detail->stems_output = output(1);
+
+    // sized for a render quantum up front, so process() only grows them for longer ones
+    _detail->pocketmod_render_buffer.resize(AudioNode::ProcessingSizeInFrames * 2);
+    _detail->fade_buffer.resize(AudioNode::ProcessingSizeInFrames * 2);
 
     if (s_registered)
         initialize();
@@ -83,51 +1038,244 @@ PocketModNode::~PocketModNode()
     delete _detail;
 }
 
-void PocketModNode::loadMOD(const char* path)
+std::shared_ptr<PocketModSong> PocketModNode::loadSong(const char* path, bool unrollSamples)
 {
-    FILE* f = fopen(path, "rb");
-    if (!f)
+    std::string key = std::string(path) + (unrollSamples ? "|unrolled" : "");
+
+    std::lock_guard<std::mutex> lock(s_song_cache_mutex);
+    for (auto i = s_song_cache.begin(); i != s_song_cache.end();)
+    {
+        if (i->second.expired())
+            i = s_song_cache.erase(i);
+        else
+            ++i;
+    }
+
+    auto cached = s_song_cache.find(key);
+    if (cached != s_song_cache.end())
+    {
+        if (std::shared_ptr<PocketModSong> song = cached->second.lock())
+            return song;
+    }
+
+    std::shared_ptr<PocketModSong> song = std::make_shared<PocketModSong>();
+    if (!song->file.map(path))
     {
         printf("Couldn't open %s\n", path);
-        return;
+        return {};
     }
 
-    fseek(f, 0, SEEK_END);
-    _detail->mod_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    _detail->mod_data = (char*) malloc(_detail->mod_size);
-    fread(_detail->mod_data, 1, _detail->mod_size, f);
-    fclose(f);
-    
-    if (!pocketmod_init(&_detail->context, _detail->mod_data, _detail->mod_size, _detail->ac->sampleRate()))
+    if (!song->load(song->file.data, song->file.size, unrollSamples))
+        return {};
+
+    s_song_cache[key] = song;
+    return song;
+}
+
+std::shared_ptr<PocketModSong> PocketModNode::loadSong(const void* data, size_t size, bool unrollSamples)
+{
+    std::shared_ptr<PocketModSong> song = std::make_shared<PocketModSong>();
+    if (!song->load(data, size, unrollSamples))
+        return {};
+
+    return song;
+}
+
+bool PocketModNode::loadMOD(const char* path)
+{
+    return _detail->publish(loadSong(path, _detail->unroll_samples));
+}
+
+bool PocketModNode::loadMOD(const void* data, size_t size)
+{
+    return _detail->publish(loadSong(data, size, _detail->unroll_samples));
+}
+
+bool PocketModNode::play(std::shared_ptr<PocketModSong> song)
+{
+    return _detail->publish(std::move(song));
+}
+
+bool PocketModNode::queueSong(std::shared_ptr<PocketModSong> song, float crossfade)
+{
+    std::unique_ptr<PocketModPlayback> p = _detail->prepareStart(song);
+    if (!p)
+        return false;
+
+    _detail->collectRetired();
+    _detail->addQueuedSong(*p);
+    _detail->fitStems();
+    _detail->queued.enqueue({ p.release(), crossfade });
+    return true;
+}
+
+bool PocketModNode::scheduleSong(float when, std::shared_ptr<PocketModSong> song, float crossfade)
+{
+    std::unique_ptr<PocketModPlayback> p = _detail->prepareStart(song);
+    if (!p)
+        return false;
+
+    _detail->collectRetired();
+    _detail->addQueuedSong(*p);
+    _detail->fitStems();
+    _detail->schedule(when, command_next, crossfade, std::move(p));
+    return true;
+}
+
+bool PocketModNode::seek(int order, int line)
+{
+    return _detail->publish(_detail->prepareSeek(order, line));
+}
+
+bool PocketModNode::seek(double seconds)
+{
+    return _detail->publish(_detail->prepareSeek(seconds));
+}
+
+void PocketModNode::start(float when)
+{
+    // prepared in case the song has ended by the time the start is applied
+    _detail->schedule(when, command_start, 0, _detail->prepareRewind());
+}
+
+void PocketModNode::pause(float when)
+{
+    _detail->schedule(when, command_pause, 0);
+}
+
+void PocketModNode::stop(float when)
+{
+    _detail->schedule(when, command_stop, 0, _detail->prepareRewind());
+}
+
+bool PocketModNode::scheduleSeek(float when, int order, int line)
+{
+    std::unique_ptr<PocketModPlayback> p = _detail->prepareSeek(order, line);
+    if (!p)
+        return false;
+
+    _detail->schedule(when, command_seek, 0, std::move(p));
+    return true;
+}
+
+bool PocketModNode::scheduleSeek(float when, double seconds)
+{
+    std::unique_ptr<PocketModPlayback> p = _detail->prepareSeek(seconds);
+    if (!p)
+        return false;
+
+    _detail->schedule(when, command_seek, 0, std::move(p));
+    return true;
+}
+
+void PocketModNode::setTempo(float when, float bpm)
+{
+    _detail->schedule(when, command_tempo, bpm);
+}
+
+double PocketModNode::position() const
+{
+    return _detail->position.load();
+}
+
+double PocketModNode::duration() const
+{
+    std::shared_ptr<PocketModSong> song = _detail->currentSong();
+    if (!song)
+        return 0;
+
+    const int rate = (int) _detail->ac->sampleRate();
+    const PocketModSongIndex* index = song->index(rate);
+    return index ? (double) index->length / rate : 0;
+}
+
+double PocketModNode::duration(const std::shared_ptr<PocketModSong>& song)
+{
+    if (!song)
+        return 0;
+
+    // the duration hardly depends on the rate, so measure at a fixed one
+    // without building a seek index
+    const int rate = 44100;
+    pocketmod_context c;
+    if (!pocketmod_init(&c, &song->song, rate))
+        return 0;
+
+    const uint64_t limit = (uint64_t) rate * PocketModSongIndex::max_seconds;
+    uint64_t frame = 0;
+    while (frame < limit && pocketmod_loop_count(&c) == 0)
     {
-        printf("Couldn't load MOD file\n");
-        return;
+        int advanced = pocketmod_advance(&c, (int) (limit - frame));
+        if (advanced <= 0)
+            break;
+        frame += advanced;
     }
+    return (double) frame / rate;
+}
 
-    
-    _detail->mod_playing = true;
+void PocketModNode::setStems(bool enabled, bool panned)
+{
+    // under the render lock, so the render thread never sees the new layout with the old width
+    ContextRenderLock r(_detail->ac, "PocketModNode::setStems");
+    _detail->stems_panned = panned;
+    _detail->stems = enabled;
+    _detail->resizeStems(r);
+}
+
+void PocketModNode::setLoopLimit(int loops)
+{
+    _detail->loop_limit = loops;
+}
+
+void PocketModNode::setOnEnded(std::function<void()> fn)
+{
+    _detail->collectRetired();
+    _detail->pending_on_ended.enqueue(fn ? new std::function<void()>(std::move(fn)) : nullptr);
+}
+
+void PocketModNode::setInterpolation(Interpolation mode)
+{
+    switch (mode)
+    {
+    case Interpolation::Nearest: _detail->interpolation = POCKETMOD_INTERPOLATE_NEAREST; break;
+    case Interpolation::Linear: _detail->interpolation = POCKETMOD_INTERPOLATE_LINEAR; break;
+    case Interpolation::Cubic: _detail->interpolation = POCKETMOD_INTERPOLATE_CUBIC; break;
+    case Interpolation::Sinc: _detail->interpolation = POCKETMOD_INTERPOLATE_SINC; break;
+    }
+}
+
+void PocketModNode::setUnrollSamples(bool unroll)
+{
+    _detail->unroll_samples = unroll;
 }
 
 void PocketModNode::process(ContextRenderLock &r, int bufferSize)
 {
+    NODE_TRACE_SCOPE("PocketMod process");
+    NODE_REALTIME_SCOPE("PocketMod process");
     AudioBus * outputBus = output(0)->bus(r);
+    AudioBus * stemsBus = output(1)->bus(r);
+    NodeRenderTimer timer(_detail->stats, bufferSize);
 
     if (!isInitialized())
     {
         if (outputBus)
             outputBus->zero();
+        if (stemsBus)
+            stemsBus->zero();
 
         _detail->clearSchedules();
         return;
     }
 
     // move incoming commands to the internal schedule
+    int arrived = 0;
     {
         PocketModNodeEvent s;
         while (_detail->incoming.try_dequeue(s))
         {
             _detail->queue.push(s);
+            ++arrived;
         }
     }
 
@@ -135,13 +1283,27 @@ void PocketModNode::process(ContextRenderLock &r, int bufferSize)
     double quantumStart = ac.currentTime();
     double quantumEnd = quantumStart + (double) bufferSize / ac.sampleRate();
 
-    // any events to service now?
+    _detail->acquirePending();
 
-    int events = 0;
     outputBus->zero();
+    stemsBus->zero();
+    if (!_detail->stems)
+        stemsBus = nullptr;
+
+    if (_detail->pocketmod_render_buffer.size() < (size_t) bufferSize * 2)
+        _detail->pocketmod_render_buffer.resize(bufferSize * 2);
+    if (_detail->fade_buffer.size() < (size_t) bufferSize * 2)
+        _detail->fade_buffer.resize(bufferSize * 2);
+
+    // render up to each event that falls within this quantum, then apply it
+
+    int rendered = 0;
     while (!_detail->queue.empty() && _detail->queue.top().when < quantumEnd)
     {
-        auto& top = _detail->queue.top();
+        const PocketModNodeEvent& top = _detail->queue.top();
+        NODE_TRACE_INSTANT("PocketMod event", top.command);
+        if (top.when < quantumStart)
+            _detail->stats.recordLate(quantumStart - top.when);
 
         // compute the exact sample the event occurs at
         int offset = (top.when < quantumStart) ? 0 : static_cast<int>((top.when - quantumStart) * ac.sampleRate());
@@ -150,37 +1312,39 @@ void PocketModNode::process(ContextRenderLock &r, int bufferSize)
         if (offset > bufferSize - 1)
             offset = bufferSize - 1;
 
-        // make a little popping sound
-        float* data = outputBus->channel(0)->mutableData();
-        for (int i = std::max(0, offset - 4); i < std::min(offset + 4, bufferSize); ++i)
-            data[i] = 1;
+        _detail->render(outputBus, stemsBus, rendered, offset);
+        rendered = std::max(rendered, offset);
 
+        _detail->apply(top, offset);
         _detail->queue.pop();
-        ++events;
+        ++timer.events;
     }
-    
-    if (_detail->mod_playing)
-    {
-        if (_detail->pocketmod_render_buffer.size() < bufferSize * 2)
-            _detail->pocketmod_render_buffer.resize(bufferSize * 2);
+    _detail->render(outputBus, stemsBus, rendered, bufferSize);
+    _detail->stats.recordQueues(arrived, _detail->queue.size());
 
-        int i = 0;
-        while (i < bufferSize)
-        {
-            i += pocketmod_render(&_detail->context, &_detail->pocketmod_render_buffer[i], bufferSize * 2 * sizeof(float));
-        }
-        
-        float* dataL = outputBus->channel(0)->mutableData();
-        float* dataR = outputBus->channel(1)->mutableData();
-        for (i = 0; i < AudioNode::ProcessingSizeInFrames; ++i)
-        {
-            dataL[i] = _detail->pocketmod_render_buffer[i * 2];
-            dataR[i] = _detail->pocketmod_render_buffer[i * 2 + 1];
-        }
-    }
+    if (_detail->playback)
+        _detail->position = (double) _detail->playback->frame / ac.sampleRate();
+    timer.voices = _detail->activeVoices();
+
+    outputBus->clearSilentFlag();
+    if (stemsBus)
+        stemsBus->clearSilentFlag();
+}
+
+NodeRenderStats PocketModNode::renderStats() const
+{
+    return _detail->stats.snapshot();
+}
+
+void PocketModNode::resetRenderStats()
+{
+    _detail->stats.reset();
+}
 
-    //if (events > 0)
-        outputBus->clearSilentFlag();
+bool PocketModNode::propagatesSilence(ContextRenderLock&) const
+{
+    // stopped, paused or ended with nothing scheduled, so process() would only write silence
+    return !_detail->playing && _detail->queue.empty() && _detail->incoming.size_approx() == 0;
 }
 
 void PocketModNode::reset(ContextRenderLock&)
@@ -4,6 +4,12 @@
 #define POCKETMOD_NODE
 
 #include <LabSound/core/AudioNode.h>
+#include "NodeRenderStats.h"
+#include <functional>
+#include <memory>
+
+// Parsed, read-only song data, shared by every node that plays it
+struct PocketModSong;
 
 class PocketModNode : public lab::AudioNode
 {
@@ -22,10 +28,106 @@ public:
     virtual void process(lab::ContextRenderLock &, int bufferSize) override;
     virtual void reset(lab::ContextRenderLock &) override;
 
-    void loadMOD(const char* path);
+    // Memory maps the file and switches to it at the start of the next
+    // render quantum; the previous song is released on a later load.
+    bool loadMOD(const char* path);
+
+    // As above, but plays song data owned by the caller, which must remain
+    // valid for as long as this node might play it.
+    bool loadMOD(const void* data, size_t size);
+
+    // Songs loaded by path are cached, so every node playing the same file
+    // shares one mapping and one parse; only the playback state, about a
+    // kilobyte, is per node. The song is released with its last reference.
+    static std::shared_ptr<PocketModSong> loadSong(const char* path, bool unrollSamples = true);
+    static std::shared_ptr<PocketModSong> loadSong(const void* data, size_t size, bool unrollSamples = true);
+    bool play(std::shared_ptr<PocketModSong> song);
+
+    // Songs to play after the current one, in order, with no gap. A song
+    // moves on when it reaches its loop limit, or after playing once when
+    // no limit is set. With a crossfade, the outgoing song keeps playing,
+    // looping if it must, and fades out while the next fades in; only then
+    // are two songs rendered at once. The stems output follows the
+    // incoming song only. scheduleSong switches at a given time instead,
+    // ahead of the queue. Both prepare the song on the calling thread, and
+    // the ended callback fires for every song that ends.
+    bool queueSong(std::shared_ptr<PocketModSong> song, float crossfade = 0.f);
+    bool scheduleSong(float when, std::shared_ptr<PocketModSong> song, float crossfade = 0.f);
+
+    // Jump within the current song, either to a line of an entry in the
+    // pattern order or to a time. Playback state is restored from a snapshot
+    // taken at load time at the start of each pattern, then advanced to the
+    // exact position without mixing, off the audio thread. The render thread
+    // switches over at the start of its next quantum.
+    bool seek(int order, int line);
+    bool seek(double seconds);
+
+    // Transport commands, applied at the exact frame they fall on. Unlike
+    // TinySoundFontNode, which takes a context time, when is in seconds
+    // relative to the context's currentTime() at the call. Loading a song
+    // does not start playback; stop pauses and rewinds to the start of the song.
+    // Scheduled seeks are prepared immediately, off the audio thread. The
+    // tempo acts like a song's own Fxx command, which may later override it.
+    void start(float when);
+    void pause(float when);
+    void stop(float when);
+    bool scheduleSeek(float when, int order, int line);
+    bool scheduleSeek(float when, double seconds);
+    void setTempo(float when, float bpm);
+
+    // How many times the song loops before it ends; -1, the default, loops
+    // forever and 0 plays it once. A loop is counted when playback returns to
+    // a pattern it has already played. Once the song ends the node outputs
+    // silence and, with nothing else scheduled, is skipped by the graph
+    // entirely. Starting it again plays the song from the top. The callback
+    // is delivered through the context's event queue, off the audio thread;
+    // a new one takes over from the next render quantum.
+    void setLoopLimit(int loops);
+    void setOnEnded(std::function<void()> fn);
+
+    // Seconds into the current song, as of the last rendered quantum
+    double position() const;
+
+    // Seconds until the current song, or the given one, first loops back.
+    // Songs are simulated without mixing, so this is cheap enough to run
+    // over a whole catalog. Songs that never loop report half an hour.
+    double duration() const;
+    static double duration(const std::shared_ptr<PocketModSong>& song);
+
+    // Output 1 carries each tracker channel of the song on its own bus
+    // channel, for per-instrument effects and stem mixing. By default each
+    // stem is mono at full volume, leaving panning to downstream nodes;
+    // panned stems take a left and right bus channel per tracker channel, as
+    // in the song's own mix, and fall back to mono past 16 tracker channels.
+    // Output 0 still carries the stereo mix. Off by default, in which case
+    // output 1 is a single silent channel. The output is resized when songs
+    // are loaded or queued, not while rendering, so it is as wide as the
+    // widest of the current and queued songs; narrower songs leave the
+    // channels past their own silent.
+    void setStems(bool enabled, bool panned = false);
+
+    // Resampling quality, from cheapest to best. Linear is the default.
+    // Cubic and sinc need unrolled samples, see below, and play as linear
+    // without them. Sinc is a fixed 8 tap kernel, so it removes imaging
+    // but not the aliasing of samples pitched far above the output rate.
+    // Applies from the next render quantum.
+    enum class Interpolation { Nearest, Linear, Cubic, Sinc };
+    void setInterpolation(Interpolation mode);
+
+    // When enabled (the default), loadMOD converts the song's samples to
+    // float with their loops unrolled into a guard band, so that rendering
+    // reads contiguous floats instead of converting and wrapping per sample.
+    // Costs four bytes per sample frame, and again per frame of each loop,
+    // which is kept a second time for reading back across the loop point;
+    // takes effect on the next loadMOD.
+    void setUnrollSamples(bool unroll);
+
+    // Render time and schedule counters, see NodeRenderStats.h; voices are tracker channels sounding
+    NodeRenderStats renderStats() const;
+    void resetRenderStats();
 
 private:
-    virtual bool propagatesSilence(lab::ContextRenderLock& r) const override { return false; }
+    virtual bool propagatesSilence(lab::ContextRenderLock& r) const override;
     virtual double tailTime(lab::ContextRenderLock & r) const override { return 0; }
     virtual double latencyTime(lab::ContextRenderLock & r) const override { return 0; }
 };
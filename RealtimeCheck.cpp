@@ -0,0 +1,248 @@
+
+#include "RealtimeCheck.h"
+
+#if defined(LABSYNTH_RT_CHECK)
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+    #include <dlfcn.h>
+    #include <execinfo.h>
+    #include <pthread.h>
+    #include <time.h>
+#endif
+
+namespace
+{
+    thread_local const char* t_scope = nullptr;
+    thread_local int t_allowed = 0;
+    thread_local bool t_reporting = false;
+
+    std::atomic<uint64_t> s_violations { 0 };
+    const uint64_t max_reports = 16;
+    const bool s_abort = getenv("LABSYNTH_RT_ABORT") != nullptr;
+
+    void violation(const char* what, size_t size)
+    {
+        if (!t_scope || t_allowed || t_reporting)
+            return;
+
+        // reporting allocates too, which mustn't count
+        t_reporting = true;
+        const uint64_t n = s_violations.fetch_add(1, std::memory_order_relaxed);
+        if (n < max_reports || s_abort)
+        {
+            if (size)
+                fprintf(stderr, "realtime violation in %s: %s of %zu bytes\n", t_scope, what, size);
+            else
+                fprintf(stderr, "realtime violation in %s: %s\n", t_scope, what);
+#if defined(__GLIBC__)
+            void* frames[32];
+            const int count = backtrace(frames, 32);
+            backtrace_symbols_fd(frames + 1, count - 1, 2);
+#endif
+            if (n + 1 == max_reports)
+                fprintf(stderr, "further realtime violations are counted but not printed\n");
+            fflush(stderr);
+        }
+        if (s_abort)
+            abort();
+        t_reporting = false;
+    }
+
+#if defined(__GLIBC__)
+    // loads the unwinder now, since the first backtrace would otherwise do it mid-report
+    const int s_backtrace_ready = []()
+    {
+        void* frames[1];
+        return backtrace(frames, 1);
+    }();
+
+    template <typename F>
+    F next_symbol(const char* name)
+    {
+        return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+    }
+#endif
+}
+
+uint64_t RealtimeCheck::violations()
+{
+    return s_violations.load(std::memory_order_relaxed);
+}
+
+RealtimeCheck::Scope::Scope(const char* name)
+: previous(t_scope)
+{
+    t_scope = name;
+}
+
+RealtimeCheck::Scope::~Scope()
+{
+    t_scope = previous;
+}
+
+RealtimeCheck::Allow::Allow()
+{
+    ++t_allowed;
+}
+
+RealtimeCheck::Allow::~Allow()
+{
+    --t_allowed;
+}
+
+#if defined(__GLIBC__)
+
+// glibc's allocator under its internal names, which operator new ends up in too
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* p, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* p);
+
+    void* malloc(size_t size)
+    {
+        violation("malloc", size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        violation("calloc", count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* p, size_t size)
+    {
+        violation("realloc", size);
+        return __libc_realloc(p, size);
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        violation("memalign", size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        violation("aligned_alloc", size);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** out, size_t alignment, size_t size)
+    {
+        violation("posix_memalign", size);
+        if (alignment < sizeof(void*) || (alignment & (alignment - 1)))
+            return EINVAL;
+
+        void* p = __libc_memalign(alignment, size);
+        if (!p)
+            return ENOMEM;
+
+        *out = p;
+        return 0;
+    }
+
+    void free(void* p)
+    {
+        if (p)
+            violation("free", 0);
+        __libc_free(p);
+    }
+
+    // the real functions, looked up on first use; a guarded static could itself take a lock
+    typedef int (*MutexLock)(pthread_mutex_t*);
+    typedef int (*RwLock)(pthread_rwlock_t*);
+    typedef int (*Sleep)(const struct timespec*, struct timespec*);
+    typedef int (*ClockSleep)(clockid_t, int, const struct timespec*, struct timespec*);
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        static MutexLock next = nullptr;
+        if (!next)
+            next = next_symbol<MutexLock>("pthread_mutex_lock");
+        violation("pthread_mutex_lock", 0);
+        return next(mutex);
+    }
+
+    int pthread_rwlock_rdlock(pthread_rwlock_t* lock)
+    {
+        static RwLock next = nullptr;
+        if (!next)
+            next = next_symbol<RwLock>("pthread_rwlock_rdlock");
+        violation("pthread_rwlock_rdlock", 0);
+        return next(lock);
+    }
+
+    int pthread_rwlock_wrlock(pthread_rwlock_t* lock)
+    {
+        static RwLock next = nullptr;
+        if (!next)
+            next = next_symbol<RwLock>("pthread_rwlock_wrlock");
+        violation("pthread_rwlock_wrlock", 0);
+        return next(lock);
+    }
+
+    int nanosleep(const struct timespec* duration, struct timespec* remaining)
+    {
+        static Sleep next = nullptr;
+        if (!next)
+            next = next_symbol<Sleep>("nanosleep");
+        violation("nanosleep", 0);
+        return next(duration, remaining);
+    }
+
+    int clock_nanosleep(clockid_t clock, int flags, const struct timespec* duration, struct timespec* remaining)
+    {
+        static ClockSleep next = nullptr;
+        if (!next)
+            next = next_symbol<ClockSleep>("clock_nanosleep");
+        violation("clock_nanosleep", 0);
+        return next(clock, flags, duration, remaining);
+    }
+}
+
+#else
+
+void* operator new(size_t size)
+{
+    violation("operator new", size);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    violation("operator new[]", size);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p)
+        violation("operator delete", 0);
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    if (p)
+        violation("operator delete[]", 0);
+    std::free(p);
+}
+
+#endif
+
+#endif
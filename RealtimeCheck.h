@@ -0,0 +1,68 @@
+
+#ifndef REALTIME_CHECK_H
+#define REALTIME_CHECK_H
+
+// A debug check that the nodes' render paths never allocate or block. Built
+// only with LABSYNTH_RT_CHECK defined (the CMake option LABSYNTHTOY_RT_CHECK);
+// otherwise the macros below compile to nothing.
+//
+//     NODE_REALTIME_SCOPE("PocketMod process");   // the rest of the scope must be realtime safe
+//     NODE_REALTIME_ALLOW();                      // except for the rest of this one
+//
+// While a thread is inside a realtime scope, the check reports every heap
+// allocation or free and every blocking call it makes, with the name of the
+// scope and a stack trace, to stderr. On glibc it interposes malloc and its
+// relatives, which also covers operator new, pthread mutex and rwlock locks,
+// and sleeps; elsewhere it replaces operator new and delete only. Only the first few violations are printed, but all are counted.
+// Setting LABSYNTH_RT_ABORT in the environment aborts on the first one.
+//
+// Allowed sections are for known, rare exceptions, each with a comment
+// saying why it is there.
+
+#include <cstdint>
+
+#if defined(LABSYNTH_RT_CHECK)
+
+class RealtimeCheck
+{
+public:
+    static bool enabled() { return true; }
+
+    // violations seen since startup, from any thread
+    static uint64_t violations();
+
+    struct Scope
+    {
+        explicit Scope(const char* name);
+        ~Scope();
+
+        const char* previous;
+    };
+
+    struct Allow
+    {
+        Allow();
+        ~Allow();
+    };
+};
+
+#define NODE_REALTIME_CONCAT_(a, b) a##b
+#define NODE_REALTIME_CONCAT(a, b) NODE_REALTIME_CONCAT_(a, b)
+#define NODE_REALTIME_SCOPE(name) RealtimeCheck::Scope NODE_REALTIME_CONCAT(node_realtime_scope_, __LINE__)(name)
+#define NODE_REALTIME_ALLOW() RealtimeCheck::Allow NODE_REALTIME_CONCAT(node_realtime_allow_, __LINE__)
+
+#else
+
+class RealtimeCheck
+{
+public:
+    static bool enabled() { return false; }
+    static uint64_t violations() { return 0; }
+};
+
+#define NODE_REALTIME_SCOPE(name) ((void) 0)
+#define NODE_REALTIME_ALLOW() ((void) 0)
+
+#endif
+
+#endif
@@ -1,17 +1,29 @@
 
 #include "TinySoundFontNode.h"
+#include "MidiSong.h"
+#include "NodeScheduleQueue.h"
+#include "NodeTrace.h"
+#include "RealtimeCheck.h"
 #include <LabSound/core/AudioBus.h>
 #include <LabSound/core/AudioContext.h>
 #include <LabSound/extended/AudioContextLock.h>
 #include <LabSound/core/AudioNodeOutput.h>
 #include <LabSound/extended/Registry.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <string>
 
 #include "concurrentqueue.h"
 
 #define TSF_IMPLEMENTATION
 #include "TinySoundFont/tsf.h"
+#include "TinySoundFont/tml.h"
 
 /*
 
@@ -62,6 +74,13 @@ const static unsigned char MinimalSoundFont[] =
         70,86,83,100,72,74,100,163,39,241,163,59,175,59,179,9,179,134,187,6,186,2,194,5,194,15,200,6,202,96,206,159,209,35,213,213,216,45,220,221,223,76,227,221,230,91,234,242,237,105,241,8,245,118,248,32,252
 };
 
+// Sound fonts loaded by path, kept for the life of the process. Each node
+// plays a tsf_copy of the cached font, which shares its presets and sample
+// data and only has its own voices and channels. tsf's reference count on
+// the shared data isn't atomic, so copies are made and closed under the mutex.
+std::mutex s_sound_font_mutex;
+std::map<std::string, tsf*> s_sound_fonts;
+
 const int command_note_on = 0;
 const int command_note_off = 2;
 const int command_note_all_off = 3;
@@ -72,6 +91,79 @@ const int command_set_drums_preset = 7;
 const int command_set_preset = 8;
 const int command_channel_pitchbend = 9;
 const int command_channel_midi_control = 10;
+const int command_midi_play = 11;
+const int command_midi_stop = 12;
+
+    // A song being played by the render thread. Made and freed off the
+    // render thread, since the song may be released with it.
+    struct MidiPlayback
+    {
+        std::shared_ptr<MidiSong> song;
+        size_t next = 0;                    // the next event to apply
+        double from = 0;                    // song time playback starts at
+        double start = 0;                   // context time of the song's start
+        MidiState state;                    // the channels as the song has them at from
+    };
+
+    // Decodes a MIDI byte stream, keeping running status between blocks
+    struct MidiParser
+    {
+        uint8_t status = 0;
+        uint8_t data[2] = { 0, 0 };
+        int count = 0;
+        bool sysex = false;
+
+        // data bytes following a status
+        static int length(uint8_t s)
+        {
+            if (s == 0xf2)
+                return 2;
+            if (s == 0xf1 || s == 0xf3)
+                return 1;
+            const int type = s & 0xf0;
+            return type == 0xc0 || type == 0xd0 ? 1 : 2;
+        }
+
+        // true when b completes a channel message
+        bool feed(uint8_t b)
+        {
+            // realtime messages may come anywhere, even within other messages
+            if (b >= 0xf8)
+                return false;
+
+            if (b & 0x80)
+            {
+                // SysEx and system common messages cancel running status; of
+                // the latter, only those with data bytes need following
+                sysex = b == 0xf0;
+                status = b < 0xf0 || b == 0xf1 || b == 0xf2 || b == 0xf3 ? b : 0;
+                count = 0;
+                return false;
+            }
+
+            if (sysex || !status)
+                return false;
+
+            data[count++] = b;
+            if (count < length(status))
+                return false;
+
+            count = 0;
+            if (status < 0xf0)
+                return true;
+
+            status = 0;
+            return false;
+        }
+    };
+
+    // a block of bytes from sendMidi, as stored in the ring ahead of them
+    struct MidiBlock
+    {
+        double when;
+        uint32_t size;
+        uint32_t source;
+    };
 
     struct Scheduled
     {
@@ -79,6 +171,7 @@ const int command_channel_midi_control = 10;
         int preset_index; int key; int aux; float vel;
         int command;
         int id; // id enforces total order, if two midi commands occur simultaneously, their total enqueue order will be respected
+        MidiPlayback* playback = nullptr;   // for command_midi_play
 
         bool operator<(const Scheduled& rhs) const
         {
@@ -100,24 +193,61 @@ struct TinySoundFontNode::Detail
 {
     tsf* sound_font = nullptr;
     moodycamel::ConcurrentQueue<Scheduled> incoming;
-    std::priority_queue<Scheduled> queue;
+    NodeScheduleQueue<Scheduled> queue;
     int rate = 0;
-    int id = 0;
+    std::atomic<int> id { 0 };  // events may come from several threads, such as a player's and a live input's
+    NodeRenderCounters stats;
+
+    // the song the render thread is playing, and playbacks it has let go of,
+    // for the control thread to free. The render thread retires playbacks
+    // through the producer token, since a queue's first enqueue from a new
+    // thread allocates.
+    MidiPlayback* midi = nullptr;
+    std::shared_ptr<MidiSong> midi_song;    // the song last played, for seeking
+    moodycamel::ConcurrentQueue<MidiPlayback*> retired;
+    moodycamel::ProducerToken retire_token { retired };
+
+    // blocks from sendMidi. Senders take the mutex to write; the render
+    // thread reads without locking, and alone owns the parsers, one per
+    // source so that each keeps its own running status.
+    static const size_t stream_capacity = 1 << 16;
+    std::vector<uint8_t> stream;
+    std::atomic<uint64_t> stream_write { 0 };
+    std::atomic<uint64_t> stream_read { 0 };
+    std::mutex stream_mutex;
+    MidiParser parsers[TinySoundFontNode::max_midi_sources];
+    std::atomic<int> midi_sources { 0 };    // handed out by newMidiSource
 
     Detail(float rate)
     : rate((int) rate)
+    , stream(stream_capacity)
     {
         // by default have the MinimalSoundFont loaded.
         sound_font = tsf_load_memory(MinimalSoundFont, sizeof(MinimalSoundFont));
+        prepare();
+    }
+
+    // Sets up the sound font for rendering. tsf grows its voices and MIDI
+    // channels on demand, which would allocate on the render thread, so
+    // both are allocated here instead: fixing the voice count allocates
+    // them all, and touching the last MIDI channel allocates all sixteen,
+    // at their defaults.
+    void prepare()
+    {
         if (sound_font)
         {
-            tsf_set_output(sound_font, TSF_MONO, (int) rate, -10);
+            tsf_set_output(sound_font, TSF_MONO, rate, -10);
             tsf_set_max_voices(sound_font, 128);
+            tsf_channel_set_bank(sound_font, 15, 0);
         }
     }
 
     ~Detail()
     {
+        collectRetired();
+        delete midi;
+
+        std::lock_guard<std::mutex> lock(s_sound_font_mutex);
         if (sound_font)
         {
             tsf_close(sound_font);
@@ -127,27 +257,277 @@ struct TinySoundFontNode::Detail
 
     void load_sf2(char const*const path)
     {
+        NODE_TRACE_SCOPE("TinySoundFont load sf2");
+        std::lock_guard<std::mutex> lock(s_sound_font_mutex);
         if (sound_font)
         {
             tsf_close(sound_font);
             sound_font = nullptr;
         }
 
-        sound_font = tsf_load_filename(path);
-        if (sound_font)
-        {
-            tsf_set_output(sound_font, TSF_MONO, rate, -10);
-            tsf_set_max_voices(sound_font, 128);
-        }
+        tsf*& shared = s_sound_fonts[path];
+        if (!shared)
+            shared = tsf_load_filename(path);
+
+        if (shared)
+            sound_font = tsf_copy(shared);
+        else
+            s_sound_fonts.erase(path);
+
+        prepare();
     }
 
     void clearSchedules()
     {
+        // songs waiting to play are retired rather than deleted, and through
+        // the render thread's token, since this may run on the render thread.
+        // The only other caller is the destructor, once the node is out of the graph
         Scheduled s;
-        while (incoming.try_dequeue(s)) {}
+        size_t dropped = queue.size();
+        while (incoming.try_dequeue(s))
+        {
+            if (s.playback)
+                retired.enqueue(retire_token, s.playback);
+            ++dropped;
+        }
         while (!queue.empty())
+        {
+            if (queue.top().playback)
+                retired.enqueue(retire_token, queue.top().playback);
             queue.pop();
-        incoming.enqueue({ 0., 0,0,0, command_clear_schedule, ++id });
+        }
+        stats.recordDropped(dropped);
+        incoming.enqueue({ 0., 0, 0, 0, 0, command_clear_schedule, ++id });
+    }
+
+    // called from the control thread to free playbacks the render thread has let go of
+    void collectRetired()
+    {
+        MidiPlayback* p;
+        while (retired.try_dequeue(p))
+            delete p;
+    }
+
+    void streamCopy(uint64_t at, const void* src, size_t size)
+    {
+        const size_t offset = size_t(at & (stream_capacity - 1));
+        const size_t first = std::min(size, stream_capacity - offset);
+        memcpy(&stream[offset], src, first);
+        memcpy(&stream[0], (const uint8_t*) src + first, size - first);
+    }
+
+    void streamPeek(uint64_t at, void* dst, size_t size) const
+    {
+        const size_t offset = size_t(at & (stream_capacity - 1));
+        const size_t first = std::min(size, stream_capacity - offset);
+        memcpy(dst, &stream[offset], first);
+        memcpy((uint8_t*) dst + first, &stream[0], size - first);
+    }
+
+    bool sendMidi(double when, const uint8_t* bytes, size_t size, int source)
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        const uint64_t write = stream_write.load(std::memory_order_relaxed);
+        const uint64_t read = stream_read.load(std::memory_order_acquire);
+        if (sizeof(MidiBlock) + size > stream_capacity - size_t(write - read))
+        {
+            stats.recordDropped(1);
+            return false;
+        }
+
+        const MidiBlock block = { when, uint32_t(size), uint32_t(source) };
+        streamCopy(write, &block, sizeof(MidiBlock));
+        streamCopy(write + sizeof(MidiBlock), bytes, size);
+        stream_write.store(write + sizeof(MidiBlock) + size, std::memory_order_release);
+        return true;
+    }
+
+    // called from the render thread; the oldest block not yet played
+    bool nextBlock(MidiBlock& block) const
+    {
+        const uint64_t read = stream_read.load(std::memory_order_relaxed);
+        if (read == stream_write.load(std::memory_order_acquire))
+            return false;
+
+        streamPeek(read, &block, sizeof(MidiBlock));
+        return true;
+    }
+
+    // called from the render thread; decodes and applies the oldest block
+    int playBlock(const MidiBlock& block)
+    {
+        const uint64_t read = stream_read.load(std::memory_order_relaxed);
+        const uint64_t begin = read + sizeof(MidiBlock);
+        MidiParser& parser = parsers[block.source];
+        int messages = 0;
+        for (uint64_t i = begin; i < begin + block.size; ++i)
+        {
+            if (parser.feed(stream[size_t(i & (stream_capacity - 1))]))
+            {
+                apply(parser);
+                ++messages;
+            }
+        }
+        stream_read.store(begin + block.size, std::memory_order_release);
+        return messages;
+    }
+
+    // called with the render lock held, when the node isn't initialized or is reset;
+    // the blocks not yet played are dropped, along with the running status
+    void dropStream()
+    {
+        stream_read.store(stream_write.load(std::memory_order_acquire), std::memory_order_release);
+        for (MidiParser& parser : parsers)
+            parser = MidiParser();
+    }
+
+    // called from the render thread
+    void endMidi()
+    {
+        if (midi)
+        {
+            retired.enqueue(retire_token, midi);
+            midi = nullptr;
+        }
+    }
+
+    // called from the render thread; at is the context time the event is applied at
+    void apply(const Scheduled& s, double at)
+    {
+        if (s.command == command_note_on)
+        {
+            NODE_TRACE_SCOPE("TinySoundFont voice");
+            tsf_note_on(sound_font, s.preset_index, s.key, s.vel);
+        }
+        else if (s.command == command_note_off)
+        {
+            tsf_note_off(sound_font, s.preset_index, s.key);
+        }
+        else if (s.command == command_note_all_off)
+        {
+            tsf_note_off_all(sound_font);
+        }
+        else if (s.command == command_channel_note_on)
+        {
+            NODE_TRACE_SCOPE("TinySoundFont voice");
+            tsf_channel_note_on(sound_font, s.preset_index, s.key, s.vel);
+        }
+        else if (s.command == command_channel_note_off)
+        {
+            tsf_channel_note_off(sound_font, s.preset_index, s.key);
+        }
+        else if (s.command == command_set_drums_preset)
+        {
+            tsf_channel_set_presetnumber(sound_font, s.preset_index, s.key, true);
+        }
+        else if (s.command == command_set_preset)
+        {
+            tsf_channel_set_presetnumber(sound_font, s.preset_index, s.key, false);
+        }
+        else if (s.command == command_channel_pitchbend)
+        {
+            tsf_channel_set_pitchwheel(sound_font, s.preset_index, s.key);
+        }
+        else if (s.command == command_channel_midi_control)
+        {
+            tsf_channel_midi_control(sound_font, s.preset_index, s.key, s.aux);
+        }
+        else if (s.command == command_midi_play)
+        {
+            // a late start plays the song from its start point, late, rather than rushing it
+            if (midi)
+                tsf_note_off_all(sound_font);
+            endMidi();
+            midi = s.playback;
+            midi->start = at - midi->from;
+            apply(midi->state);
+            if (midi->next == midi->song->events.size())
+                endMidi();
+        }
+        else if (s.command == command_midi_stop)
+        {
+            endMidi();
+            tsf_note_off_all(sound_font);
+        }
+    }
+
+    // called from the render thread, to set the channels up as a song has them
+    void apply(const MidiState& state)
+    {
+        for (int ch = 0; ch < 16; ++ch)
+        {
+            if (!(state.used & (1 << ch)))
+                continue;
+
+            const MidiState::Channel& c = state.channels[ch];
+            tsf_channel_midi_control(sound_font, ch, TML_ALL_CTRL_OFF, 0);
+            for (int i = 0; i < MidiState::chased_count; ++i)
+            {
+                if (c.controls[i] != 0xff)
+                    tsf_channel_midi_control(sound_font, ch, MidiState::chased_controls[i], c.controls[i]);
+            }
+            tsf_channel_set_presetnumber(sound_font, ch, c.program, ch == 9);
+            tsf_channel_set_pitchwheel(sound_font, ch, c.pitch_bend);
+        }
+    }
+
+    // called from the render thread, for a message from the byte stream
+    void apply(const MidiParser& p)
+    {
+        const int channel = p.status & 0x0f;
+        switch (p.status & 0xf0)
+        {
+        case 0x80:
+            tsf_channel_note_off(sound_font, channel, p.data[0]);
+            break;
+        case 0x90:
+            // a note on without velocity is a note off
+            if (p.data[1])
+            {
+                NODE_TRACE_SCOPE("TinySoundFont voice");
+                tsf_channel_note_on(sound_font, channel, p.data[0], p.data[1] / 127.0f);
+            }
+            else
+            {
+                tsf_channel_note_off(sound_font, channel, p.data[0]);
+            }
+            break;
+        case 0xb0:
+            tsf_channel_midi_control(sound_font, channel, p.data[0], p.data[1]);
+            break;
+        case 0xc0:
+            tsf_channel_set_presetnumber(sound_font, channel, p.data[0], channel == 9);
+            break;
+        case 0xe0:
+            tsf_channel_set_pitchwheel(sound_font, channel, p.data[0] | (p.data[1] << 7));
+            break;
+        }
+    }
+
+    // called from the render thread, for the song's events
+    void apply(const MidiEvent& e)
+    {
+        switch (e.type)
+        {
+        case TML_PROGRAM_CHANGE:
+            tsf_channel_set_presetnumber(sound_font, e.channel, e.data1, e.channel == 9);
+            break;
+        case TML_NOTE_ON:
+        {
+            NODE_TRACE_SCOPE("TinySoundFont voice");
+            tsf_channel_note_on(sound_font, e.channel, e.data1, e.data2 / 127.0f);
+            break;
+        }
+        case TML_NOTE_OFF:
+            tsf_channel_note_off(sound_font, e.channel, e.data1);
+            break;
+        case TML_PITCH_BEND:
+            tsf_channel_set_pitchwheel(sound_font, e.channel, e.pitchBend());
+            break;
+        case TML_CONTROL_CHANGE:
+            tsf_channel_midi_control(sound_font, e.channel, e.data1, e.data2);
+            break;
+        }
     }
 
 
@@ -192,95 +572,130 @@ int TinySoundFontNode::presetCount() const
 
 void TinySoundFontNode::process(ContextRenderLock &r, int bufferSize)
 {
+    NODE_TRACE_SCOPE("TinySoundFont process");
+    NODE_REALTIME_SCOPE("TinySoundFont process");
     AudioBus * outputBus = output(0)->bus(r);
+    NodeRenderTimer timer(_detail->stats, bufferSize);
     if (!isInitialized())
     {
         if (outputBus)
             outputBus->zero();
 
         _detail->clearSchedules();
+        _detail->dropStream();
         return;
     }
 
     // move requested starts to the internal schedule if there's a source bus.
     // if there's no source bus, the schedule requests are discarded.
+    int arrived = 0;
     {
         Scheduled s;
         while (_detail->incoming.try_dequeue(s))
         {
+            // the clear marker is internal, so it isn't counted as an arrival
             if (s.command == command_clear_schedule)
             {
+                _detail->stats.recordDropped(_detail->queue.size());
                 while (!_detail->queue.empty())
+                {
+                    if (_detail->queue.top().playback)
+                        _detail->retired.enqueue(_detail->retire_token, _detail->queue.top().playback);
                     _detail->queue.pop();
+                }
             }
             else
             {
                 _detail->queue.push(s);
+                ++arrived;
             }
         }
     }
 
     auto& ac = *r.context();
+    const double rate = ac.sampleRate();
     double quantumStart = ac.currentTime();
-    double quantumEnd = quantumStart + (double)bufferSize / ac.sampleRate();
+    double quantumEnd = quantumStart + (double)bufferSize / rate;
 
-    // any events to service now?
+    // scheduled events, the song's messages and blocks of streamed bytes are
+    // taken in time order, and each is applied at its own frame, once the
+    // frames before it are rendered
 
-    int events = 0;
     outputBus->zero();
-    while (!_detail->queue.empty() && _detail->queue.top().when < quantumEnd)
+    float* out = outputBus->channel(0)->mutableData();
+    int rendered = 0;
+    while (true)
     {
-        auto& s = _detail->queue.top();
-
-        // note, although we could calculate an exact note start time,
-        // tinysoundfont doesn't offer that granularity.
-        //size_t offset = (s.when < quantumStartTime) ? 0 : static_cast<size_t>(s.when * r.context()->sampleRate());
-        if (s.command == command_note_on)
-        {
-            tsf_note_on(_detail->sound_font, s.preset_index, s.key, s.vel);
-        }
-        else if (s.command == command_note_off)
-        {
-            tsf_note_off(_detail->sound_font, s.preset_index, s.key);
-        }
-        else if (s.command == command_note_all_off)
+        const bool scheduled = !_detail->queue.empty() && _detail->queue.top().when < quantumEnd;
+        const double event_when = scheduled ? _detail->queue.top().when : quantumEnd;
+        MidiPlayback* midi = _detail->midi;
+        const MidiEvent* msg = midi && midi->next < midi->song->events.size() ? &midi->song->events[midi->next] : nullptr;
+        const double msg_when = msg ? midi->start + msg->time * 1e-3 : quantumEnd;
+        MidiBlock block;
+        const double block_when = _detail->nextBlock(block) ? block.when : quantumEnd;
+        const double when = std::min(event_when, std::min(msg_when, block_when));
+        if (when >= quantumEnd)
+            break;
+
+        const int frame = std::min(bufferSize, std::max(rendered, (int) std::floor((when - quantumStart) * rate + 0.5)));
+        if (frame > rendered)
         {
-            tsf_note_off_all(_detail->sound_font);
+            tsf_render_float(_detail->sound_font, out + rendered, frame - rendered, 0);
+            rendered = frame;
         }
-        else if (s.command == command_channel_note_on)
-        {
-            tsf_channel_note_on(_detail->sound_font, s.preset_index, s.key, s.vel);
-        }
-        else if (s.command == command_channel_note_off)
-        {
-            tsf_channel_note_off(_detail->sound_font, s.preset_index, s.key);
-        }
-        else if (s.command == command_set_drums_preset)
-        {
-            tsf_channel_set_presetnumber(_detail->sound_font, s.preset_index, s.key, true);
-        }
-        else if (s.command == command_set_preset)
+
+        if (scheduled && event_when == when)
         {
-            tsf_channel_set_presetnumber(_detail->sound_font, s.preset_index, s.key, false);
+            auto& s = _detail->queue.top();
+            NODE_TRACE_INSTANT("TinySoundFont event", s.command);
+            if (s.when < quantumStart)
+                _detail->stats.recordLate(quantumStart - s.when);
+
+            _detail->apply(s, std::max(s.when, quantumStart));
+            _detail->queue.pop();
+            ++timer.events;
         }
-        else if (s.command == command_channel_pitchbend)
+        else if (msg && msg_when == when)
         {
-            tsf_channel_set_pitchwheel(_detail->sound_font, s.preset_index, s.key);
+            NODE_TRACE_INSTANT("TinySoundFont song event", msg->type);
+            _detail->apply(*msg);
+            if (++midi->next == midi->song->events.size())
+                _detail->endMidi();
+            ++timer.events;
         }
-        else if (s.command == command_channel_midi_control)
+        else
         {
-            tsf_channel_midi_control(_detail->sound_font, s.preset_index, s.key, s.aux);
+            NODE_TRACE_INSTANT("TinySoundFont stream block", block.size);
+            if (block.when < quantumStart)
+                _detail->stats.recordLate(quantumStart - block.when);
+
+            timer.events += _detail->playBlock(block);
         }
-        _detail->queue.pop();
     }
+    _detail->stats.recordQueues(arrived, _detail->queue.size());
 
-    tsf_render_float(_detail->sound_font, outputBus->channel(0)->mutableData(), bufferSize, 0);
+    if (rendered < bufferSize)
+        tsf_render_float(_detail->sound_font, out + rendered, bufferSize - rendered, 0);
     outputBus->clearSilentFlag();
+
+    if (_detail->sound_font)
+        timer.voices = tsf_active_voice_count(_detail->sound_font);
+}
+
+NodeRenderStats TinySoundFontNode::renderStats() const
+{
+    return _detail->stats.snapshot();
+}
+
+void TinySoundFontNode::resetRenderStats()
+{
+    _detail->stats.reset();
 }
 
 void TinySoundFontNode::reset(ContextRenderLock & r)
 {
     _detail->clearSchedules();
+    _detail->dropStream();
 }
 
 void TinySoundFontNode::noteOn(float when, int preset_index, int key, float vel)
@@ -300,6 +715,36 @@ void TinySoundFontNode::noteOff(float when, int preset_index, int key)
 }
 
 void TinySoundFontNode::channelNoteOn(float when, int channel, int key, float vel)
+{
+    channelNoteOn(double(when), channel, key, vel);
+}
+
+void TinySoundFontNode::channelNoteOff(float when, int channel, int key)
+{
+    channelNoteOff(double(when), channel, key);
+}
+
+void TinySoundFontNode::channelSetPreset(float when, int channel, int program, bool midi_drums)
+{
+    channelSetPreset(double(when), channel, program, midi_drums);
+}
+
+void TinySoundFontNode::channelSetPitchWheel(float when, int channel, int bend)
+{
+    channelSetPitchWheel(double(when), channel, bend);
+}
+
+void TinySoundFontNode::channelMidiControl(float when, int channel, int control, int value)
+{
+    channelMidiControl(double(when), channel, control, value);
+}
+
+void TinySoundFontNode::allNotesOff(float when)
+{
+    allNotesOff(double(when));
+}
+
+void TinySoundFontNode::channelNoteOn(double when, int channel, int key, float vel)
 {
     if (_detail->sound_font)
     {
@@ -307,7 +752,7 @@ void TinySoundFontNode::channelNoteOn(float when, int channel, int key, float ve
     }
 }
 
-void TinySoundFontNode::channelNoteOff(float when, int channel, int key)
+void TinySoundFontNode::channelNoteOff(double when, int channel, int key)
 {
     if (_detail->sound_font)
     {
@@ -315,7 +760,7 @@ void TinySoundFontNode::channelNoteOff(float when, int channel, int key)
     }
 }
 
-void TinySoundFontNode::channelSetPreset(float when, int channel, int program, bool midi_drums)
+void TinySoundFontNode::channelSetPreset(double when, int channel, int program, bool midi_drums)
 {
     if (_detail->sound_font)
     {
@@ -326,7 +771,7 @@ void TinySoundFontNode::channelSetPreset(float when, int channel, int program, b
     }
 }
 
-void TinySoundFontNode::channelSetPitchWheel(float when, int channel, int bend)
+void TinySoundFontNode::channelSetPitchWheel(double when, int channel, int bend)
 {
     if (_detail->sound_font)
     {
@@ -334,7 +779,7 @@ void TinySoundFontNode::channelSetPitchWheel(float when, int channel, int bend)
     }
 }
 
-void TinySoundFontNode::channelMidiControl(float when, int channel, int control, int value)
+void TinySoundFontNode::channelMidiControl(double when, int channel, int control, int value)
 {
     if (_detail->sound_font)
     {
@@ -343,7 +788,7 @@ void TinySoundFontNode::channelMidiControl(float when, int channel, int control,
 }
 
 
-void TinySoundFontNode::allNotesOff(float when)
+void TinySoundFontNode::allNotesOff(double when)
 {
     if (_detail->sound_font)
     {
@@ -351,4 +796,47 @@ void TinySoundFontNode::allNotesOff(float when)
     }
 }
 
+bool TinySoundFontNode::sendMidi(double when, const uint8_t* bytes, size_t size, int source)
+{
+    if (!_detail->sound_font || !size || source < 0 || source >= max_midi_sources)
+        return false;
+
+    return _detail->sendMidi(when, bytes, size, source);
+}
+
+int TinySoundFontNode::newMidiSource()
+{
+    return 1 + _detail->midi_sources++ % (max_midi_sources - 1);
+}
+
+void TinySoundFontNode::playMidi(double when, std::shared_ptr<MidiSong> song, double from)
+{
+    _detail->collectRetired();
+    _detail->midi_song = song;
+    if (_detail->sound_font && song && !song->events.empty())
+    {
+        MidiPlayback* p = new MidiPlayback();
+        p->song = std::move(song);
+        p->from = std::max(0., from);
+        p->next = p->song->find(p->from);
+        p->state = p->song->stateAt(p->from);
+        _detail->incoming.enqueue({ when, 0, 0, 0, 0, command_midi_play, ++_detail->id, p });
+    }
+}
+
+void TinySoundFontNode::seekMidi(double when, double seconds)
+{
+    if (_detail->midi_song)
+        playMidi(when, _detail->midi_song, seconds);
+}
+
+void TinySoundFontNode::stopMidi(double when)
+{
+    _detail->collectRetired();
+    if (_detail->sound_font)
+    {
+        _detail->incoming.enqueue({ when, 0, 0, 0, 0, command_midi_stop, ++_detail->id });
+    }
+}
+
 
@@ -3,7 +3,13 @@
 #define TINYSOUNDFONTNODE_H
 
 #include <LabSound/core/AudioNode.h>
+#include "NodeRenderStats.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 
+// Parsed, read-only MIDI file, see MidiSong.h
+struct MidiSong;
 
 class TinySoundFontNode : public lab::AudioNode
 {
@@ -22,6 +28,8 @@ public:
     virtual void process(lab::ContextRenderLock &, int bufferSize) override;
     virtual void reset(lab::ContextRenderLock &) override;
 
+    // Sound fonts are cached by path and shared read-only between nodes, so
+    // loading the same file into many nodes parses it once.
     void load_sf2(char const*const path);
     int presetCount() const;
 
@@ -37,6 +45,58 @@ public:
 
     void allNotesOff(float when);
 
+    // The same, with when as a double, for senders such as MidiFilePlayer
+    // that keep their context times as doubles: a float drifts by samples
+    // once the context has been running for an hour or so.
+    void channelNoteOn(double when, int channel, int key, float vel);
+    void channelNoteOff(double when, int channel, int key);
+
+    void channelSetPreset(double when, int channel, int program, bool midi_drums);
+    void channelSetPitchWheel(double when, int channel, int bend);
+    void channelMidiControl(double when, int channel, int control, int value);
+
+    void allNotesOff(double when);
+
+    // Raw MIDI bytes, any number of channel messages at a time, with running
+    // status. The bytes are copied into a ring and decoded by the render
+    // thread, which applies a whole block at once at when. A dense
+    // controller stream then costs one copy per block rather than one event
+    // per message. Blocks play in the order they were sent, so a block
+    // timed before the one ahead of it waits for it. Running status and a
+    // message split between blocks carry over to the next block from the
+    // same source; sources that share a node, such as two MidiInputs, each
+    // take their own number from newMidiSource. Source 0 is the default,
+    // shared by everything that doesn't. SysEx and system messages are
+    // skipped. Polyphonic and channel pressure are parsed but have no effect
+    // in tsf. Returns false, and counts the block as dropped, if the ring
+    // is full.
+    static const int max_midi_sources = 16;
+    bool sendMidi(double when, const uint8_t* bytes, size_t size, int source = 0);
+
+    // a source number for sendMidi, from 1 up; past the last, numbers are reused
+    int newMidiSource();
+
+    // Plays a MIDI file from the render thread, which steps through the song
+    // itself and applies each message at its exact frame, with no queueing
+    // per message. This suits songs known in advance, such as background
+    // music; MidiFilePlayer suits songs that are paused, seeked or retimed.
+    // A song replaces any song already playing. Stopping or replacing a song
+    // releases every note, including those played directly. As with the
+    // other events, when is a context time, here a double so that it stays
+    // sample accurate however long the context has been running.
+    //
+    // Playing from a point in the song, or seeking the song last played,
+    // first restores the programs, pitch wheels and controllers the song has
+    // set by then, in one batch on the render thread. The state is looked up
+    // off the render thread, from snapshots the song keeps for each second.
+    void playMidi(double when, std::shared_ptr<MidiSong> song, double from = 0);
+    void seekMidi(double when, double seconds);
+    void stopMidi(double when);
+
+    // Render time and schedule counters, see NodeRenderStats.h
+    NodeRenderStats renderStats() const;
+    void resetRenderStats();
+
 private:
     virtual bool propagatesSilence(lab::ContextRenderLock& r) const override { return false; }
     virtual double tailTime(lab::ContextRenderLock & r) const override { return 0; }
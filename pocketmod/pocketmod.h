@@ -7,10 +7,19 @@
 extern "C" {
 #endif
 
+typedef struct pocketmod_song pocketmod_song;
 typedef struct pocketmod_context pocketmod_context;
-int pocketmod_init(pocketmod_context *c, const void *data, int size, int rate);
+int pocketmod_load(pocketmod_song *s, const void *data, int size);
+int pocketmod_init(pocketmod_context *c, const pocketmod_song *s, int rate);
+int pocketmod_context_size(int num_channels);
 int pocketmod_render(pocketmod_context *c, void *buffer, int size);
+int pocketmod_render_channels(pocketmod_context *c, float **channels,
+                              int panned, void *buffer, int samples);
+int pocketmod_advance(pocketmod_context *c, int samples);
 int pocketmod_loop_count(pocketmod_context *c);
+int pocketmod_set_interpolation(pocketmod_context *c, int mode);
+int pocketmod_unrolled_size(const pocketmod_song *s);
+int pocketmod_unroll_samples(pocketmod_song *s, void *buffer, int size);
 
 #ifndef POCKETMOD_MAX_CHANNELS
 #define POCKETMOD_MAX_CHANNELS 32
@@ -20,9 +29,24 @@ int pocketmod_loop_count(pocketmod_context *c);
 #define POCKETMOD_MAX_SAMPLES 31
 #endif
 
+/* Samples of padding on each side of an unrolled sample. The sinc mode */
+/* reads three samples back and four ahead of a position that may be up */
+/* to one sample past the end, so it needs at least five.               */
+#ifndef POCKETMOD_GUARD_SAMPLES
+#define POCKETMOD_GUARD_SAMPLES 8
+#endif
+
+/* Interpolation modes for pocketmod_set_interpolation() */
+#define POCKETMOD_INTERPOLATE_NEAREST 0
+#define POCKETMOD_INTERPOLATE_LINEAR  1
+#define POCKETMOD_INTERPOLATE_CUBIC   2
+#define POCKETMOD_INTERPOLATE_SINC    3
+
 typedef struct {
     signed char *data;          /* Sample data buffer                      */
     unsigned int length;        /* Data length (in bytes)                  */
+    float *unrolled;            /* Float copy with unrolled loop (or null) */
+    float *looped;              /* Float copy of the loop alone (or null)  */
 } _pocketmod_sample;
 
 typedef struct {
@@ -49,13 +73,13 @@ typedef struct {
     unsigned char paramEA;      /* Parameter memory for EAx                */
     unsigned char paramEB;      /* Parameter memory for EBx                */
     unsigned char real_volume;  /* Volume (with tremolo adjustment)        */
+    unsigned char looped;       /* Wrapped at the loop end since triggered */
     float position;             /* Position in sample data buffer          */
     float increment;            /* Position increment per output sample    */
 } _pocketmod_chan;
 
-struct pocketmod_context
+struct pocketmod_song
 {
-    /* Read-only song data */
     _pocketmod_sample samples[POCKETMOD_MAX_SAMPLES];
     unsigned char *source;      /* Pointer to source MOD data              */
     unsigned char *order;       /* Pattern order table                     */
@@ -65,6 +89,12 @@ struct pocketmod_context
     unsigned char num_patterns; /* Patterns in the file (1..128)           */
     unsigned char num_samples;  /* Sample count (15 or 31)                 */
     unsigned char num_channels; /* Channel count (1..32)                   */
+};
+
+struct pocketmod_context
+{
+    /* Read-only song data, which may be shared between contexts */
+    const pocketmod_song *song;
 
     /* Timing variables */
     int samples_per_second;     /* Sample rate (set by user)               */
@@ -76,15 +106,19 @@ struct pocketmod_context
     int loop_count;             /* How many times the song has looped      */
 
     /* Render state */
-    _pocketmod_chan channels[POCKETMOD_MAX_CHANNELS];
     unsigned char pattern_delay;/* EEx pattern delay counter               */
     unsigned int lfo_rng;       /* RNG used for the random LFO waveform    */
+    unsigned char interpolation;/* POCKETMOD_INTERPOLATE_* mode            */
 
     /* Position in song (from least to most granular) */
     signed char pattern;        /* Current pattern in order                */
     signed char line;           /* Current line in pattern                 */
     short tick;                 /* Current tick in line                    */
     float sample;               /* Current sample in tick                  */
+
+    /* Channel state, last so that a context for a song with fewer channels */
+    /* can be allocated short; see pocketmod_context_size()                 */
+    _pocketmod_chan channels[POCKETMOD_MAX_CHANNELS];
 };
 
 #ifdef POCKETMOD_IMPLEMENTATION
@@ -101,7 +135,7 @@ struct pocketmod_context
     } while (0)
 
 /* Shortcut to sample metadata (sample must be nonzero) */
-#define POCKETMOD_SAMPLE(c, sample) ((c)->source + 12 + 30 * (sample))
+#define POCKETMOD_SAMPLE(s, sample) ((s)->source + 12 + 30 * (sample))
 
 /* Channel dirty flags */
 #define POCKETMOD_PITCH  0x01
@@ -259,6 +293,7 @@ static void _pocketmod_volume_slide(_pocketmod_chan *ch, int param)
 
 static void _pocketmod_next_line(pocketmod_context *c)
 {
+    const pocketmod_song *s = c->song;
     unsigned char (*data)[4];
     int i, pos, pattern_break = -1;
 
@@ -269,16 +304,16 @@ static void _pocketmod_next_line(pocketmod_context *c)
 
     /* Move to the next pattern if this was the last line */
     if (++c->line == 64) {
-        if (++c->pattern == c->length) {
-            c->pattern = c->reset;
+        if (++c->pattern == s->length) {
+            c->pattern = s->reset;
         }
         c->line = 0;
     }
 
     /* Find the pattern data for the current line */
-    pos = (c->order[c->pattern] * 64 + c->line) * c->num_channels * 4;
-    data = (unsigned char(*)[4]) (c->patterns + pos);
-    for (i = 0; i < c->num_channels; i++) {
+    pos = (s->order[c->pattern] * 64 + c->line) * s->num_channels * 4;
+    data = (unsigned char(*)[4]) (s->patterns + pos);
+    for (i = 0; i < s->num_channels; i++) {
 
         /* Decode columns */
         int sample = (data[i][0] & 0xf0) | (data[i][2] >> 4);
@@ -293,7 +328,8 @@ static void _pocketmod_next_line(pocketmod_context *c)
         /* Set sample */
         if (sample) {
             if (sample <= POCKETMOD_MAX_SAMPLES) {
-                unsigned char *sample_data = POCKETMOD_SAMPLE(c, sample);
+                unsigned char *sample_data = POCKETMOD_SAMPLE(s, sample);
+                ch->looped = ch->looped && ch->sample == sample;
                 ch->sample = sample;
                 ch->finetune = sample_data[2] & 0x0f;
                 ch->volume = _pocketmod_min(sample_data[3], 0x40);
@@ -302,6 +338,7 @@ static void _pocketmod_next_line(pocketmod_context *c)
                 }
             } else {
                 ch->sample = 0;
+                ch->looped = 0;
             }
         }
 
@@ -314,6 +351,7 @@ static void _pocketmod_next_line(pocketmod_context *c)
                     ch->period = period;
                     ch->dirty |= POCKETMOD_PITCH;
                     ch->position = 0.0f;
+                    ch->looped = 0;
                     ch->lfo_step = 0;
                 } else {
                     ch->delayed = period;
@@ -344,12 +382,13 @@ static void _pocketmod_next_line(pocketmod_context *c)
                 if (period != 0 || sample != 0) {
                     ch->param9 = ch->param ? ch->param : ch->param9;
                     ch->position = ch->param9 << 8;
+                    ch->looped = 0;
                 }
             } break;
 
             /* Bxx: Jump to pattern */
             case 0xB: {
-                c->pattern = ch->param < c->length ? ch->param : 0;
+                c->pattern = ch->param < s->length ? ch->param : 0;
                 c->line = -1;
             } break;
 
@@ -425,8 +464,8 @@ static void _pocketmod_next_line(pocketmod_context *c)
     /* There are songs that rely on this behavior!)                         */
     if (pattern_break != -1) {
         c->line = (pattern_break < 64 ? pattern_break : 0) - 1;
-        if (++c->pattern == c->length) {
-            c->pattern = c->reset;
+        if (++c->pattern == s->length) {
+            c->pattern = s->reset;
         }
     }
 }
@@ -446,7 +485,7 @@ static void _pocketmod_next_tick(pocketmod_context *c)
     }
 
     /* Make per-tick adjustments for all channels */
-    for (i = 0; i < c->num_channels; i++) {
+    for (i = 0; i < c->song->num_channels; i++) {
         _pocketmod_chan *ch = &c->channels[i];
         int param = ch->param;
 
@@ -465,6 +504,7 @@ static void _pocketmod_next_tick(pocketmod_context *c)
             case 0xE9: {
                 if (!(param && c->tick % param)) {
                     ch->position = 0.0f;
+                    ch->looped = 0;
                     ch->lfo_step = 0;
                 }
             } break;
@@ -483,6 +523,7 @@ static void _pocketmod_next_tick(pocketmod_context *c)
                     ch->dirty |= POCKETMOD_VOLUME | POCKETMOD_PITCH;
                     ch->period = ch->delayed;
                     ch->position = 0.0f;
+                    ch->looped = 0;
                     ch->lfo_step = 0;
                 }
             } break;
@@ -561,14 +602,119 @@ static void _pocketmod_next_tick(pocketmod_context *c)
     }
 }
 
+/* Windowed sinc kernels for 8 taps, starting 3 samples before the      */
+/* position, at 32 fractional offsets plus one to interpolate toward.   */
+/* Blackman window, each kernel normalized to unity gain.               */
+#define POCKETMOD_SINC_TAPS 8
+#define POCKETMOD_SINC_PHASES 32
+static const float _pocketmod_sinc_table[POCKETMOD_SINC_PHASES + 1][POCKETMOD_SINC_TAPS] = {
+    {0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+    {-0.0006361f, 0.0050353f, -0.0230187f, 0.9981391f, 0.0253155f, -0.0055841f, 0.0007494f, -0.0000004f},
+    {-0.0011632f, 0.0095096f, -0.0437128f, 0.9925728f, 0.0528781f, -0.0116957f, 0.0016146f, -0.0000034f},
+    {-0.0015868f, 0.0134187f, -0.0620759f, 0.9833472f, 0.082616f, -0.0183042f, 0.0025966f, -0.0000116f},
+    {-0.0019138f, 0.0167667f, -0.0781225f, 0.9705365f, 0.1144357f, -0.0253693f, 0.003694f, -0.0000274f},
+    {-0.0021516f, 0.0195644f, -0.0918865f, 0.9542427f, 0.1482216f, -0.0328408f, 0.0049034f, -0.0000532f},
+    {-0.0023085f, 0.0218289f, -0.1034203f, 0.9345938f, 0.1838365f, -0.0406582f, 0.0062189f, -0.0000912f},
+    {-0.0023932f, 0.023583f, -0.1127931f, 0.9117429f, 0.2211229f, -0.0487509f, 0.0076318f, -0.0001433f},
+    {-0.0024147f, 0.0248543f, -0.1200898f, 0.8858659f, 0.2599029f, -0.0570383f, 0.0091309f, -0.0002111f},
+    {-0.002382f, 0.0256741f, -0.1254089f, 0.8571605f, 0.2999799f, -0.0654299f, 0.0107018f, -0.0002955f},
+    {-0.0023038f, 0.0260771f, -0.1288611f, 0.8258433f, 0.3411401f, -0.0738258f, 0.0123275f, -0.0003973f},
+    {-0.0021888f, 0.0261004f, -0.1305675f, 0.7921482f, 0.3831534f, -0.0821168f, 0.0139876f, -0.0005165f},
+    {-0.0020452f, 0.0257826f, -0.1306578f, 0.7563239f, 0.4257756f, -0.0901857f, 0.0156592f, -0.0006525f},
+    {-0.0018807f, 0.0251635f, -0.1292683f, 0.7186311f, 0.4687501f, -0.0979076f, 0.017316f, -0.0008041f},
+    {-0.0017024f, 0.0242831f, -0.1265404f, 0.6793406f, 0.5118102f, -0.105151f, 0.0189293f, -0.0009694f},
+    {-0.0015168f, 0.0231812f, -0.1226188f, 0.6387302f, 0.554681f, -0.1117788f, 0.0204675f, -0.0011457f},
+    {-0.0013296f, 0.0218968f, -0.1176495f, 0.5970823f, 0.5970823f, -0.1176495f, 0.0218968f, -0.0013296f},
+    {-0.0011457f, 0.0204675f, -0.1117788f, 0.554681f, 0.6387302f, -0.1226188f, 0.0231812f, -0.0015168f},
+    {-0.0009694f, 0.0189293f, -0.105151f, 0.5118102f, 0.6793406f, -0.1265404f, 0.0242831f, -0.0017024f},
+    {-0.0008041f, 0.017316f, -0.0979076f, 0.4687501f, 0.7186311f, -0.1292683f, 0.0251635f, -0.0018807f},
+    {-0.0006525f, 0.0156592f, -0.0901857f, 0.4257756f, 0.7563239f, -0.1306578f, 0.0257826f, -0.0020452f},
+    {-0.0005165f, 0.0139876f, -0.0821168f, 0.3831534f, 0.7921482f, -0.1305675f, 0.0261004f, -0.0021888f},
+    {-0.0003973f, 0.0123275f, -0.0738258f, 0.3411401f, 0.8258433f, -0.1288611f, 0.0260771f, -0.0023038f},
+    {-0.0002955f, 0.0107018f, -0.0654299f, 0.2999799f, 0.8571605f, -0.1254089f, 0.0256741f, -0.002382f},
+    {-0.0002111f, 0.0091309f, -0.0570383f, 0.2599029f, 0.8858659f, -0.1200898f, 0.0248543f, -0.0024147f},
+    {-0.0001433f, 0.0076318f, -0.0487509f, 0.2211229f, 0.9117429f, -0.1127931f, 0.023583f, -0.0023932f},
+    {-0.0000912f, 0.0062189f, -0.0406582f, 0.1838365f, 0.9345938f, -0.1034203f, 0.0218289f, -0.0023085f},
+    {-0.0000532f, 0.0049034f, -0.0328408f, 0.1482216f, 0.9542427f, -0.0918865f, 0.0195644f, -0.0021516f},
+    {-0.0000274f, 0.003694f, -0.0253693f, 0.1144357f, 0.9705365f, -0.0781225f, 0.0167667f, -0.0019138f},
+    {-0.0000116f, 0.0025966f, -0.0183042f, 0.082616f, 0.9833472f, -0.0620759f, 0.0134187f, -0.0015868f},
+    {-0.0000034f, 0.0016146f, -0.0116957f, 0.0528781f, 0.9925728f, -0.0437128f, 0.0095096f, -0.0011632f},
+    {-0.0000004f, 0.0007494f, -0.0055841f, 0.0253155f, 0.9981391f, -0.0230187f, 0.0050353f, -0.0006361f},
+    {0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f}
+};
+
+/* Catmull-Rom spline through x[-1]..x[2] */
+static float _pocketmod_cubic(const float *x, float t)
+{
+    float a = 0.5f * (x[2] - x[-1]) + 1.5f * (x[0] - x[1]);
+    float b = x[-1] - 2.5f * x[0] + 2.0f * x[1] - 0.5f * x[2];
+    float c = 0.5f * (x[1] - x[-1]);
+    return ((a * t + b) * t + c) * t + x[0];
+}
+
+/* Windowed sinc through x[-3]..x[4] */
+static float _pocketmod_sinc(const float *x, float t)
+{
+    int i;
+    float phase = t * POCKETMOD_SINC_PHASES;
+    int p = (int) phase;
+    float f = phase - p;
+    const float *k0 = _pocketmod_sinc_table[p];
+    const float *k1 = _pocketmod_sinc_table[p + 1];
+    float s0 = 0.0f, s1 = 0.0f;
+    x -= 3;
+    for (i = 0; i < POCKETMOD_SINC_TAPS; i++) {
+        s0 += k0[i] * x[i];
+        s1 += k1[i] * x[i];
+    }
+    return s0 + f * (s1 - s0);
+}
+
+/* Resamplers over an unrolled sample, one per interpolation mode, so the */
+/* mode is chosen once per run rather than tested for every sample. Each  */
+/* position is computed from the start of the run rather than accumulated */
+/* so it doesn't drift, and pocketmod_advance can skip the run in one     */
+/* step and land on exactly the same position. 'data' holds the sample   */
+/* from position 'origin' on.                                             */
+#define POCKETMOD_RESAMPLER(name, interpolate)                               \
+static void name(const float *data, int origin, float start,                \
+                 float increment, float *left, float *right, int step,      \
+                 float level_l, float level_r, int num)                     \
+{                                                                           \
+    int i;                                                                  \
+    for (i = 0; i < num; i++) {                                             \
+        float position = start + increment * i;                             \
+        int x0 = (int) position;                                            \
+        float t = position - x0;                                            \
+        const float *x = data + (x0 - origin);                              \
+        float s = (interpolate);                                            \
+        (void) t;                                                           \
+        *left += level_l * s;                                               \
+        left += step;                                                       \
+        if (right) {                                                        \
+            *right += level_r * s;                                          \
+            right += step;                                                  \
+        }                                                                   \
+    }                                                                       \
+}
+
+POCKETMOD_RESAMPLER(_pocketmod_resample_nearest, x[0])
+POCKETMOD_RESAMPLER(_pocketmod_resample_linear, x[0] + t * (x[1] - x[0]))
+POCKETMOD_RESAMPLER(_pocketmod_resample_cubic, _pocketmod_cubic(x, t))
+POCKETMOD_RESAMPLER(_pocketmod_resample_sinc, _pocketmod_sinc(x, t))
+
+/* Mix a channel into 'left' and 'right', each 'step' floats apart. Without */
+/* a right output, the channel is written to 'left' at full volume, unpanned */
 static void _pocketmod_render_channel(pocketmod_context *c,
                                       _pocketmod_chan *chan,
-                                      float *output,
+                                      float *left,
+                                      float *right,
+                                      int step,
                                       int samples_to_write)
 {
     /* Gather some loop data */
-    _pocketmod_sample *sample = &c->samples[chan->sample - 1];
-    unsigned char *data = POCKETMOD_SAMPLE(c, chan->sample);
+    const _pocketmod_sample *sample = &c->song->samples[chan->sample - 1];
+    unsigned char *data = POCKETMOD_SAMPLE(c->song, chan->sample);
     const int loop_start = ((data[4] << 8) | data[5]) << 1;
     const int loop_length = ((data[6] << 8) | data[7]) << 1;
     const int loop_end = loop_length > 2 ? loop_start + loop_length : 0xffffff;
@@ -576,7 +722,7 @@ static void _pocketmod_render_channel(pocketmod_context *c,
 
     /* Calculate left/right levels */
     const float volume = chan->real_volume / (float) (128 * 64 * 4);
-    const float level_l = volume * (1.0f - chan->balance / 255.0f);
+    const float level_l = right ? volume * (1.0f - chan->balance / 255.0f) : volume;
     const float level_r = volume * (0.0f + chan->balance / 255.0f);
 
     /* Write samples */
@@ -584,27 +730,77 @@ static void _pocketmod_render_channel(pocketmod_context *c,
     do {
 
         /* Calculate how many samples we can write in one go */
-        num = (sample_end - chan->position) / chan->increment;
+        const float start = chan->position;
+        num = (sample_end - start) / chan->increment;
         num = _pocketmod_min(num, samples_to_write);
 
-        /* Resample and write 'num' samples */
-        for (i = 0; i < num; i++) {
-            int x0 = chan->position;
-#ifdef POCKETMOD_NO_INTERPOLATION
-            float s = sample->data[x0];
-#else
+        /* Resample from the unrolled copy, which needs no loop wrap test. */
+        /* Once the channel has wrapped, the taps before the loop start   */
+        /* must read the end of the loop rather than the sample before    */
+        /* it, so read from the copy of the loop alone instead, as long   */
+        /* as the position is inside the loop that copy starts at.        */
+        if (sample->unrolled && num > 0) {
+            const float *unrolled = sample->unrolled;
+            int origin = 0;
+            if (chan->looped && sample->looped && start >= loop_start) {
+                unrolled = sample->looped;
+                origin = loop_start;
+            }
+            switch (c->interpolation) {
+            case POCKETMOD_INTERPOLATE_NEAREST:
+                _pocketmod_resample_nearest(unrolled, origin, start, chan->increment,
+                                            left, right, step, level_l, level_r, num);
+                break;
+            case POCKETMOD_INTERPOLATE_CUBIC:
+                _pocketmod_resample_cubic(unrolled, origin, start, chan->increment,
+                                          left, right, step, level_l, level_r, num);
+                break;
+            case POCKETMOD_INTERPOLATE_SINC:
+                _pocketmod_resample_sinc(unrolled, origin, start, chan->increment,
+                                         left, right, step, level_l, level_r, num);
+                break;
+            default:
+                _pocketmod_resample_linear(unrolled, origin, start, chan->increment,
+                                           left, right, step, level_l, level_r, num);
+                break;
+            }
+            left += num * step;
+            right = right ? right + num * step : 0;
+
+        /* Resample and write 'num' samples, nearest or else linear */
+        } else if (c->interpolation == POCKETMOD_INTERPOLATE_NEAREST) {
+            for (i = 0; i < num; i++) {
+                float position = start + chan->increment * i;
+                int x0 = position;
+                float s = sample->data[x0];
+                *left += level_l * s;
+                left += step;
+                if (right) {
+                    *right += level_r * s;
+                    right += step;
+                }
+            }
+        } else for (i = 0; i < num; i++) {
+            float position = start + chan->increment * i;
+            int x0 = position;
             int x1 = x0 + 1 - loop_length * (x0 + 1 >= loop_end);
-            float t = chan->position - x0;
+            float t = position - x0;
             float s = (1.0f - t) * sample->data[x0] + t * sample->data[x1];
-#endif
-            chan->position += chan->increment;
-            *output++ += level_l * s;
-            *output++ += level_r * s;
+            *left += level_l * s;
+            left += step;
+            if (right) {
+                *right += level_r * s;
+                right += step;
+            }
+        }
+        if (num > 0) {
+            chan->position = start + chan->increment * num;
         }
 
         /* Rewind the sample when reaching the loop point */
         if (chan->position >= loop_end) {
             chan->position -= loop_length;
+            chan->looped = 1;
 
         /* Cut the sample if the end is reached */
         } else if (chan->position >= sample->length) {
@@ -616,7 +812,48 @@ static void _pocketmod_render_channel(pocketmod_context *c,
     } while (num > 0);
 }
 
-static int _pocketmod_ident(pocketmod_context *c, unsigned char *data, int size)
+/* Move a channel's sample position as _pocketmod_render_channel would */
+static void _pocketmod_advance_channel(pocketmod_context *c,
+                                       _pocketmod_chan *chan,
+                                       int samples_to_advance)
+{
+    /* Gather some loop data */
+    const _pocketmod_sample *sample = &c->song->samples[chan->sample - 1];
+    unsigned char *data = POCKETMOD_SAMPLE(c->song, chan->sample);
+    const int loop_start = ((data[4] << 8) | data[5]) << 1;
+    const int loop_length = ((data[6] << 8) | data[7]) << 1;
+    const int loop_end = loop_length > 2 ? loop_start + loop_length : 0xffffff;
+    const float sample_end = 1 + _pocketmod_min(loop_end, sample->length);
+
+    /* Skip samples up to each loop point in a single step */
+    int num;
+    if (chan->increment <= 0.0f) {
+        return;
+    }
+    do {
+        const float start = chan->position;
+        num = (sample_end - start) / chan->increment;
+        num = _pocketmod_min(num, samples_to_advance);
+        if (num > 0) {
+            chan->position = start + chan->increment * num;
+        }
+
+        /* Rewind the sample when reaching the loop point */
+        if (chan->position >= loop_end) {
+            chan->position -= loop_length;
+            chan->looped = 1;
+
+        /* Cut the sample if the end is reached */
+        } else if (chan->position >= sample->length) {
+            chan->position = -1.0f;
+            break;
+        }
+
+        samples_to_advance -= num;
+    } while (num > 0);
+}
+
+static int _pocketmod_ident(pocketmod_song *s, unsigned char *data, int size)
 {
     int i, j;
 
@@ -649,12 +886,12 @@ static int _pocketmod_ident(pocketmod_context *c, unsigned char *data, int size)
         for (i = 0; i < (int) (sizeof(tags) / sizeof(*tags)); i++) {
             if (tags[i].name[0] == tag[0] && tags[i].name[1] == tag[1]
              && tags[i].name[2] == tag[2] && tags[i].name[3] == tag[3]) {
-                c->num_channels = tags[i].channels;
-                c->length = data[950];
-                c->reset = data[951];
-                c->order = &data[952];
-                c->patterns = &data[1084];
-                c->num_samples = 31;
+                s->num_channels = tags[i].channels;
+                s->length = data[950];
+                s->reset = data[951];
+                s->order = &data[952];
+                s->patterns = &data[1084];
+                s->num_samples = 31;
                 return 1;
             }
         }
@@ -683,42 +920,42 @@ static int _pocketmod_ident(pocketmod_context *c, unsigned char *data, int size)
     }
 
     /* It looks like we have an older 15-instrument MOD */
-    c->length = data[470];
-    c->reset = data[471];
-    c->order = &data[472];
-    c->patterns = &data[600];
-    c->num_samples = 15;
-    c->num_channels = 4;
+    s->length = data[470];
+    s->reset = data[471];
+    s->order = &data[472];
+    s->patterns = &data[600];
+    s->num_samples = 15;
+    s->num_channels = 4;
     return 1;
 }
 
-int pocketmod_init(pocketmod_context *c, const void *data, int size, int rate)
+int pocketmod_load(pocketmod_song *s, const void *data, int size)
 {
     int i, remaining, header_bytes, pattern_bytes;
-    unsigned char *byte = (unsigned char*) c;
+    unsigned char *byte;
     signed char *sample_data;
 
     /* Check that arguments look more or less sane */
-    if (!c || !data || rate <= 0 || size <= 0) {
+    if (!s || !data || size <= 0) {
         return 0;
     }
 
-    /* Zero out the whole context and identify the MOD type */
-    _pocketmod_zero(c, sizeof(pocketmod_context));
-    c->source = (unsigned char*) data;
-    if (!_pocketmod_ident(c, c->source, size)) {
+    /* Zero out the whole song and identify the MOD type */
+    _pocketmod_zero(s, sizeof(pocketmod_song));
+    s->source = (unsigned char*) data;
+    if (!_pocketmod_ident(s, s->source, size)) {
         return 0;
     }
 
     /* Check that we are compiled with support for enough channels */
-    if (c->num_channels > POCKETMOD_MAX_CHANNELS) {
+    if (s->num_channels > POCKETMOD_MAX_CHANNELS) {
         return 0;
     }
 
     /* Check that we have enough sample slots for this file */
     if (POCKETMOD_MAX_SAMPLES < 31) {
         byte = (unsigned char*) data + 20;
-        for (i = 0; i < c->num_samples; i++) {
+        for (i = 0; i < s->num_samples; i++) {
             unsigned int length = 2 * ((byte[22] << 8) | byte[23]);
             if (i >= POCKETMOD_MAX_SAMPLES && length > 2) {
                 return 0; /* Can't fit this sample */
@@ -728,26 +965,26 @@ int pocketmod_init(pocketmod_context *c, const void *data, int size, int rate)
     }
 
     /* Check that the song length is in valid range (1..128) */
-    if (c->length == 0 || c->length > 128) {
+    if (s->length == 0 || s->length > 128) {
         return 0;
     }
 
     /* Make sure that the reset pattern doesn't take us out of bounds */
-    if (c->reset >= c->length) {
-        c->reset = 0;
+    if (s->reset >= s->length) {
+        s->reset = 0;
     }
 
     /* Count how many patterns there are in the file */
-    c->num_patterns = 0;
-    for (i = 0; i < 128 && c->order[i] < 128; i++) {
-        c->num_patterns = _pocketmod_max(c->num_patterns, c->order[i]);
+    s->num_patterns = 0;
+    for (i = 0; i < 128 && s->order[i] < 128; i++) {
+        s->num_patterns = _pocketmod_max(s->num_patterns, s->order[i]);
     }
-    pattern_bytes = 256 * c->num_channels * ++c->num_patterns;
-    header_bytes = (int) ((char*) c->patterns - (char*) data);
+    pattern_bytes = 256 * s->num_channels * ++s->num_patterns;
+    header_bytes = (int) ((char*) s->patterns - (char*) data);
 
     /* Check that each pattern in the order is within file bounds */
-    for (i = 0; i < c->length; i++) {
-        if (header_bytes + 256 * c->num_channels * c->order[i] > size) {
+    for (i = 0; i < s->length; i++) {
+        if (header_bytes + 256 * s->num_channels * s->order[i] > size) {
             return 0; /* Reading this pattern would be a buffer over-read! */
         }
     }
@@ -760,18 +997,36 @@ int pocketmod_init(pocketmod_context *c, const void *data, int size, int rate)
     /* Load sample payload data, truncating ones that extend outside the file */
     remaining = size - header_bytes - pattern_bytes;
     sample_data = (signed char*) data + header_bytes + pattern_bytes;
-    for (i = 0; i < c->num_samples; i++) {
-        unsigned char *data = POCKETMOD_SAMPLE(c, i + 1);
+    for (i = 0; i < s->num_samples; i++) {
+        unsigned char *data = POCKETMOD_SAMPLE(s, i + 1);
         unsigned int length = ((data[0] << 8) | data[1]) << 1;
-        _pocketmod_sample *sample = &c->samples[i];
+        _pocketmod_sample *sample = &s->samples[i];
         sample->data = sample_data;
         sample->length = _pocketmod_min(length > 2 ? length : 0, remaining);
         sample_data += sample->length;
         remaining -= sample->length;
     }
+    return 1;
+}
+
+/* Set up a fresh context to play from the start of a pattern order index */
+static int _pocketmod_init_order(pocketmod_context *c,
+                                 const pocketmod_song *s,
+                                 int rate, int order)
+{
+    int i;
+
+    /* Check that arguments look more or less sane */
+    if (!c || !s || !s->source || rate <= 0 || order < 0 || order >= s->length) {
+        return 0;
+    }
+
+    /* Zero out the context, which may be allocated short for this song */
+    _pocketmod_zero(c, pocketmod_context_size(s->num_channels));
+    c->song = s;
 
     /* Set up ProTracker default panning for all channels */
-    for (i = 0; i < c->num_channels; i++) {
+    for (i = 0; i < s->num_channels; i++) {
         c->channels[i].balance = 0x80 + ((((i + 1) >> 1) & 1) ? 0x20 : -0x20);
     }
 
@@ -780,12 +1035,51 @@ int pocketmod_init(pocketmod_context *c, const void *data, int size, int rate)
     c->samples_per_second = rate;
     c->samples_per_tick = rate / 50.0f;
     c->lfo_rng = 0xbadc0de;
+#ifdef POCKETMOD_NO_INTERPOLATION
+    c->interpolation = POCKETMOD_INTERPOLATE_NEAREST;
+#else
+    c->interpolation = POCKETMOD_INTERPOLATE_LINEAR;
+#endif
+    c->pattern = order;
     c->line = -1;
     c->tick = c->ticks_per_line - 1;
     _pocketmod_next_tick(c);
     return 1;
 }
 
+int pocketmod_init(pocketmod_context *c, const pocketmod_song *s, int rate)
+{
+    return _pocketmod_init_order(c, s, rate, 0);
+}
+
+/* Advance song position by 'num' samples, returning 1 at a new pattern */
+static int _pocketmod_step(pocketmod_context *c, int num)
+{
+    if ((c->sample += num) >= c->samples_per_tick) {
+        c->sample -= c->samples_per_tick;
+        _pocketmod_next_tick(c);
+
+        /* Stop if a new pattern was reached */
+        if (c->line == 0 && c->tick == 0) {
+
+            /* Increment loop counter as needed */
+            if (c->visited[c->pattern >> 3] & (1 << (c->pattern & 7))) {
+                _pocketmod_zero(c->visited, sizeof(c->visited));
+                c->loop_count++;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int pocketmod_context_size(int num_channels)
+{
+    int used = _pocketmod_max(0, _pocketmod_min(num_channels, POCKETMOD_MAX_CHANNELS));
+    int unused = POCKETMOD_MAX_CHANNELS - used;
+    return (int) (sizeof(pocketmod_context) - unused * sizeof(_pocketmod_chan));
+}
+
 int pocketmod_render(pocketmod_context *c, void *buffer, int buffer_size)
 {
     int i, samples_rendered = 0;
@@ -800,10 +1094,10 @@ int pocketmod_render(pocketmod_context *c, void *buffer, int buffer_size)
 
             /* Render and mix 'num' samples from each channel */
             _pocketmod_zero(output, num * POCKETMOD_SAMPLE_SIZE);
-            for (i = 0; i < c->num_channels; i++) {
+            for (i = 0; i < c->song->num_channels; i++) {
                 _pocketmod_chan *chan = &c->channels[i];
                 if (chan->sample != 0 && chan->position >= 0.0f) {
-                    _pocketmod_render_channel(c, chan, *output, num);
+                    _pocketmod_render_channel(c, chan, output[0], output[0] + 1, 2, num);
                 }
             }
             samples_remaining -= num;
@@ -811,24 +1105,99 @@ int pocketmod_render(pocketmod_context *c, void *buffer, int buffer_size)
             output += num;
 
             /* Advance song position by 'num' samples */
-            if ((c->sample += num) >= c->samples_per_tick) {
-                c->sample -= c->samples_per_tick;
-                _pocketmod_next_tick(c);
+            if (_pocketmod_step(c, num)) {
+                break;
+            }
+        }
+    }
+    return samples_rendered * POCKETMOD_SAMPLE_SIZE;
+}
+
+int pocketmod_render_channels(pocketmod_context *c, float **channels,
+                              int panned, void *buffer, int samples)
+{
+    int i, j, samples_rendered = 0;
+    if (c && channels) {
+        float (*output)[2] = (float(*)[2]) buffer;
+        while (samples > 0) {
 
-                /* Stop if a new pattern was reached */
-                if (c->line == 0 && c->tick == 0) {
+            /* Calculate the number of samples left in this tick */
+            int num = (int) (c->samples_per_tick - c->sample);
+            num = _pocketmod_min(num + !num, samples);
 
-                    /* Increment loop counter as needed */
-                    if (c->visited[c->pattern >> 3] & (1 << (c->pattern & 7))) {
-                        _pocketmod_zero(c->visited, sizeof(c->visited));
-                        c->loop_count++;
+            /* Render 'num' samples of each channel into its own buffer */
+            if (output) {
+                _pocketmod_zero(output, num * POCKETMOD_SAMPLE_SIZE);
+            }
+            for (i = 0; i < c->song->num_channels; i++) {
+                _pocketmod_chan *chan = &c->channels[i];
+                float *left = channels[panned ? 2 * i : i] + samples_rendered;
+                float *right = panned ? channels[2 * i + 1] + samples_rendered : 0;
+                _pocketmod_zero(left, num * sizeof(float));
+                if (right) {
+                    _pocketmod_zero(right, num * sizeof(float));
+                }
+                if (chan->sample != 0 && chan->position >= 0.0f) {
+                    _pocketmod_render_channel(c, chan, left, right, 1, num);
+                }
+
+                /* Sum the channel into the stereo mix */
+                if (output && right) {
+                    for (j = 0; j < num; j++) {
+                        output[j][0] += left[j];
+                        output[j][1] += right[j];
+                    }
+                } else if (output) {
+                    const float pan_l = 1.0f - chan->balance / 255.0f;
+                    const float pan_r = 0.0f + chan->balance / 255.0f;
+                    for (j = 0; j < num; j++) {
+                        output[j][0] += pan_l * left[j];
+                        output[j][1] += pan_r * left[j];
                     }
-                    break;
                 }
             }
+            samples -= num;
+            samples_rendered += num;
+            if (output) {
+                output += num;
+            }
+
+            /* Advance song position by 'num' samples */
+            if (_pocketmod_step(c, num)) {
+                break;
+            }
         }
     }
-    return samples_rendered * POCKETMOD_SAMPLE_SIZE;
+    return samples_rendered;
+}
+
+int pocketmod_advance(pocketmod_context *c, int samples)
+{
+    int i, samples_advanced = 0;
+    if (c) {
+        while (samples > 0) {
+
+            /* Calculate the number of samples left in this tick */
+            int num = (int) (c->samples_per_tick - c->sample);
+            num = _pocketmod_min(num + !num, samples);
+
+            /* Move each channel forward by 'num' samples without mixing */
+            for (i = 0; i < c->song->num_channels; i++) {
+                _pocketmod_chan *chan = &c->channels[i];
+                if (chan->sample != 0 && chan->position >= 0.0f) {
+                    _pocketmod_advance_channel(c, chan, num);
+                }
+            }
+            samples -= num;
+            samples_advanced += num;
+
+            /* Advance song position by 'num' samples */
+            if (_pocketmod_step(c, num)) {
+                break;
+            }
+        }
+    }
+    return samples_advanced;
 }
 
 int pocketmod_loop_count(pocketmod_context *c)
@@ -836,6 +1205,87 @@ int pocketmod_loop_count(pocketmod_context *c)
     return c->loop_count;
 }
 
+int pocketmod_set_interpolation(pocketmod_context *c, int mode)
+{
+    if (!c || mode < POCKETMOD_INTERPOLATE_NEAREST || mode > POCKETMOD_INTERPOLATE_SINC) {
+        return 0;
+    }
+    if (mode == POCKETMOD_INTERPOLATE_SINC && POCKETMOD_GUARD_SAMPLES < 5) {
+        return 0;
+    }
+    c->interpolation = (unsigned char) mode;
+    return 1;
+}
+
+/* Loop bounds of a sample, or zero loop length if it doesn't loop */
+static void _pocketmod_sample_loop(const pocketmod_song *s, int i,
+                                   int *loop_start, int *loop_length)
+{
+    unsigned char *data = POCKETMOD_SAMPLE(s, i + 1);
+    *loop_start = ((data[4] << 8) | data[5]) << 1;
+    *loop_length = ((data[6] << 8) | data[7]) << 1;
+    if (*loop_length <= 2 || *loop_start + *loop_length > (int) s->samples[i].length) {
+        *loop_length = 0;
+    }
+}
+
+int pocketmod_unrolled_size(const pocketmod_song *s)
+{
+    int i, floats = 0;
+    for (i = 0; i < s->num_samples; i++) {
+        int loop_start, loop_length, length = s->samples[i].length;
+        _pocketmod_sample_loop(s, i, &loop_start, &loop_length);
+        length = loop_length ? loop_start + loop_length : length;
+        floats += length + 2 * POCKETMOD_GUARD_SAMPLES;
+        floats += loop_length ? loop_length + 2 * POCKETMOD_GUARD_SAMPLES : 0;
+    }
+    return floats * (int) sizeof(float);
+}
+
+int pocketmod_unroll_samples(pocketmod_song *s, void *buffer, int size)
+{
+    int i, j;
+    float *output = (float*) buffer;
+    if (!s || !buffer || size < pocketmod_unrolled_size(s)) {
+        return 0;
+    }
+
+    /* Convert each sample up to its loop end, then pad it with a guard band */
+    /* that is silent before the start and either silent or a copy of the   */
+    /* loop past the end, so that the resampler never needs to wrap around. */
+    /* A looping sample is followed by a second copy of its loop alone,     */
+    /* with the end of the loop in the guard band before it, which is what  */
+    /* a channel that has already wrapped reads back from the loop start.   */
+    for (i = 0; i < s->num_samples; i++) {
+        _pocketmod_sample *sample = &s->samples[i];
+        int loop_start, loop_length, length = sample->length;
+        _pocketmod_sample_loop(s, i, &loop_start, &loop_length);
+        length = loop_length ? loop_start + loop_length : length;
+        for (j = 0; j < POCKETMOD_GUARD_SAMPLES; j++) {
+            *output++ = 0.0f;
+        }
+        sample->unrolled = output;
+        for (j = 0; j < length; j++) {
+            *output++ = sample->data[j];
+        }
+        for (j = 0; j < POCKETMOD_GUARD_SAMPLES; j++) {
+            *output++ = loop_length ? sample->data[loop_start + j % loop_length] : 0.0f;
+        }
+        sample->looped = 0;
+        if (!loop_length) {
+            continue;
+        }
+        for (j = POCKETMOD_GUARD_SAMPLES; j > 0; j--) {
+            *output++ = sample->data[loop_start + (loop_length - j % loop_length) % loop_length];
+        }
+        sample->looped = output;
+        for (j = 0; j < loop_length + POCKETMOD_GUARD_SAMPLES; j++) {
+            *output++ = sample->data[loop_start + j % loop_length];
+        }
+    }
+    return 1;
+}
+
 #endif /* #ifdef POCKETMOD_IMPLEMENTATION */
 
 #ifdef __cplusplus